@@ -0,0 +1,287 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 5, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef ADAPTIVEINDEX_H_
+#define ADAPTIVEINDEX_H_
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <cstdint>
+
+namespace gamcs
+{
+
+/**
+ * @brief Mix the bits of an integer key to get a well-distributed hash value (the splitmix64 finalizer).
+ *
+ * @param [in] key the key
+ * @return the hash value
+ */
+inline uint64_t hashMix(uint64_t key)
+{
+	key ^= key >> 30;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 27;
+	key *= 0x94d049bb133111ebULL;
+	key ^= key >> 31;
+	return key;
+}
+
+/**
+ * @brief An index from integer or pointer keys to non-NULL pointer values, which adapts to its size.
+ *
+ * Entries are kept in a sorted array and binary searched while the index is small,
+ * and moved to an open-addressing hash table once the size exceeds SORTED_LIMIT.
+ * The hash table uses linear probing and backward-shift deletion, so no tombstones are left.
+ */
+template<typename K, typename V>
+class AdaptiveIndex
+{
+	public:
+		/**
+		 * Thresholds of the index.
+		 */
+		enum
+		{
+			SORTED_LIMIT = 32, /**< maximum number of entries kept in the sorted array */
+			INIT_CAPACITY = 8 /**< the initial capacity */
+		};
+
+		/**
+		 * @brief The default constructor.
+		 */
+		AdaptiveIndex() :
+				entries(NULL), num(0), cap(0), hashed(false)
+		{
+		}
+
+		/**
+		 * @brief The default destructor.
+		 */
+		~AdaptiveIndex()
+		{
+			free(entries);
+		}
+
+		/**
+		 * @brief Get the number of entries.
+		 *
+		 * @return the number
+		 */
+		uint32_t size() const
+		{
+			return num;
+		}
+
+		/**
+		 * @brief Find the value of a key.
+		 *
+		 * @param [in] key the key
+		 * @return the value, or NULL if not found
+		 */
+		V find(K key) const
+		{
+			if (hashed)
+			{
+				uint32_t mask = cap - 1;
+				for (uint32_t i = hashMix((uint64_t) key) & mask;; i = (i + 1) & mask)
+				{
+					if (entries[i].val == NULL)    // reach an empty slot
+						return NULL;
+					if (entries[i].key == key)
+						return entries[i].val;
+				}
+			}
+			else
+			{
+				uint32_t pos = lowerBound(key);
+				if (pos < num && entries[pos].key == key)
+					return entries[pos].val;
+				return NULL;
+			}
+		}
+
+		/**
+		 * @brief Insert an entry, the key must not exist in the index.
+		 *
+		 * @param [in] key the key
+		 * @param [in] val the value, which must not be NULL
+		 */
+		void insert(K key, V val)
+		{
+			assert(val != NULL);
+			if (hashed)
+			{
+				if (2 * (num + 1) > cap)    // keep the load factor under 0.5
+					rehash(2 * cap);
+				hashInsert(key, val);
+				++num;
+			}
+			else if (num == SORTED_LIMIT)    // too big for the sorted array, switch to hashing
+			{
+				rehash(4 * SORTED_LIMIT);
+				hashInsert(key, val);
+				++num;
+			}
+			else
+			{
+				if (num == cap)
+					grow(cap == 0 ? (uint32_t) INIT_CAPACITY : 2 * cap);
+				uint32_t pos = lowerBound(key);
+				memmove(entries + pos + 1, entries + pos,
+						(num - pos) * sizeof(Entry));
+				entries[pos].key = key;
+				entries[pos].val = val;
+				++num;
+			}
+		}
+
+		/**
+		 * @brief Remove an entry.
+		 *
+		 * @param [in] key the key of the entry
+		 */
+		void erase(K key)
+		{
+			if (hashed)
+			{
+				uint32_t mask = cap - 1;
+				uint32_t i = hashMix((uint64_t) key) & mask;
+				for (;; i = (i + 1) & mask)
+				{
+					if (entries[i].val == NULL)    // not found
+						return;
+					if (entries[i].key == key)
+						break;
+				}
+
+				// shift the following entries backward to fill the hole
+				uint32_t j = i;
+				while (true)
+				{
+					j = (j + 1) & mask;
+					if (entries[j].val == NULL)
+						break;
+					uint32_t home = hashMix((uint64_t) entries[j].key) & mask;
+					// move entry j to the hole i if its home slot is not in (i, j]
+					if ((j > i && (home <= i || home > j))
+							|| (j < i && (home <= i && home > j)))
+					{
+						entries[i] = entries[j];
+						i = j;
+					}
+				}
+				entries[i].val = NULL;
+				--num;
+			}
+			else
+			{
+				uint32_t pos = lowerBound(key);
+				if (pos < num && entries[pos].key == key)
+				{
+					memmove(entries + pos, entries + pos + 1,
+							(num - pos - 1) * sizeof(Entry));
+					--num;
+				}
+			}
+		}
+
+	private:
+		/**
+		 * @brief An index entry.
+		 */
+		struct Entry
+		{
+				K key; /**< the key */
+				V val; /**< the value, NULL for an empty slot in the hash table */
+		};
+
+		Entry *entries; /**< the sorted array or the hash table */
+		uint32_t num; /**< number of entries */
+		uint32_t cap; /**< capacity of entries */
+		bool hashed; /**< whether entries are organized as a hash table */
+
+		/**
+		 * @brief Find the first position in the sorted array whose key is not less than the specified key.
+		 */
+		uint32_t lowerBound(K key) const
+		{
+			uint32_t lo = 0, hi = num;
+			while (lo < hi)
+			{
+				uint32_t mid = (lo + hi) / 2;
+				if (entries[mid].key < key)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			return lo;
+		}
+
+		/**
+		 * @brief Grow the sorted array.
+		 */
+		void grow(uint32_t ncap)
+		{
+			entries = (Entry *) realloc(entries, ncap * sizeof(Entry));
+			assert(entries != NULL);
+			cap = ncap;
+		}
+
+		/**
+		 * @brief Put an entry into the hash table, there must be an empty slot.
+		 */
+		void hashInsert(K key, V val)
+		{
+			uint32_t mask = cap - 1;
+			uint32_t i = hashMix((uint64_t) key) & mask;
+			while (entries[i].val != NULL)
+				i = (i + 1) & mask;
+			entries[i].key = key;
+			entries[i].val = val;
+		}
+
+		/**
+		 * @brief Move all entries to a new hash table.
+		 *
+		 * @param [in] ncap capacity of the new table, must be a power of 2
+		 */
+		void rehash(uint32_t ncap)
+		{
+			Entry *old = entries;
+			uint32_t old_cap = cap;
+			bool old_hashed = hashed;
+
+			entries = (Entry *) calloc(ncap, sizeof(Entry));
+			assert(entries != NULL);
+			cap = ncap;
+			hashed = true;
+
+			for (uint32_t i = 0; i < (old_hashed ? old_cap : num); i++)
+			{
+				if (old[i].val != NULL)
+					hashInsert(old[i].key, old[i].val);
+			}
+			free(old);
+		}
+
+		AdaptiveIndex(const AdaptiveIndex &); /**< not copyable */
+		AdaptiveIndex &operator=(const AdaptiveIndex &); /**< not copyable */
+};
+
+}    // namespace gamcs
+
+#endif /* ADAPTIVEINDEX_H_ */
@@ -57,6 +57,9 @@ class Agent: public TSGIOM
 		void setMode(Mode mode);
 		Mode getMode();
 		void update(float original_payoff);
+		void setBatchSize(unsigned long batch_size);
+		unsigned long getBatchSize() const;
+		void flush();
 
 		static const State INVALID_STATE; /**< the invalid state indicator */
 		static const Action INVALID_ACTION; /**< the invalid action indicator */
@@ -67,6 +70,8 @@ class Agent: public TSGIOM
 		float discount_rate; /**< the discount rate [0,1) used to calculate state payoff */
 		float accuracy; /**< the accuracy of payoff, ranging [0, +inf) */
 		Mode learning_mode; /**< the learning mode, ONLINE by default */
+		unsigned long batch_size; /**< number of updates between two flushes, 1 by default */
+		unsigned long batch_count; /**< number of updates since the last flush */
 
 		OSpace constrain(State state, OSpace &avaliable_actions) const;
 
@@ -87,6 +92,7 @@ class Agent: public TSGIOM
 		 * @param [in] original_payoff original payoff of current state
 		 */
 		virtual void updateMemory(float original_payoff) = 0;
+		virtual void flushMemory();
 };
 
 /*
@@ -0,0 +1,53 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 20, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef AGENTSESSION_H_
+#define AGENTSESSION_H_
+#include "gamcs/Agent.h"
+
+namespace gamcs
+{
+
+class CSOSAgent;
+class ShardedAgent;
+
+/**
+ * @brief A session of an avatar on a CSOSAgent or ShardedAgent shared by many avatars.
+ *
+ * Each avatar connects to its own session, which keeps the current and previous states
+ * of that avatar, and learns into and decides from the shared memory.
+ * Sessions can run concurrently in different threads. On a CSOSAgent they learn one by one,
+ * on a ShardedAgent every state range is learned by its owner shard, so sessions learn without waiting for each other.
+ */
+class AgentSession: public Agent
+{
+	public:
+		AgentSession(CSOSAgent *shared_agent, int id = 0);
+		AgentSession(ShardedAgent *sharded_agent, int id = 0);
+		~AgentSession();
+
+	protected:
+		OSpace maxPayoffRule(State state, OSpace &available_actions) const;
+		void updateMemory(float original_payoff);
+
+	private:
+		CSOSAgent *shared; /**< the shared agent, NULL if a sharded agent is shared */
+		ShardedAgent *sharded; /**< the shared sharded agent, NULL if a CSOSAgent is shared */
+};
+
+}    // namespace gamcs
+
+#endif /* AGENTSESSION_H_ */
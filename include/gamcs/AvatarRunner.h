@@ -0,0 +1,103 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 26, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef AVATARRUNNER_H_
+#define AVATARRUNNER_H_
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace gamcs
+{
+
+class Avatar;
+
+/**
+ * @brief An avatar run by AvatarRunner and its statistics
+ */
+struct ar_Task
+{
+		Avatar *avatar; /**< the avatar */
+		unsigned long budget; /**< maximum steps to run, 0 for no limit */
+		unsigned long steps; /**< steps run so far */
+		double seconds; /**< time spent in stepping the avatar */
+		bool dead_end; /**< whether the avatar has reached a dead end */
+};
+
+/**
+ * @brief A deque of tasks owned by a worker thread, other workers steal from its front when they run out of work
+ */
+struct ar_WorkQueue
+{
+		std::mutex mutex; /**< protect tasks */
+		std::deque<unsigned long> tasks; /**< indexes of tasks */
+};
+
+/**
+ * @brief Run many avatars in parallel on a work-stealing thread pool.
+ *
+ * Each avatar should be connected to its own agent. An avatar is stepped by one thread at a time,
+ * in slices of SLICE_STEPS steps. When a slice is done, the avatar goes back to the queue of the thread which has run it,
+ * and idle threads steal avatars from others, or sleep until one is put back, so the threads keep busy until all avatars are done.
+ * An avatar is done when it has run its step budget or has reached a dead end (step() returns -1).
+ */
+class AvatarRunner
+{
+	public:
+		/**
+		 * Scheduling parameters.
+		 */
+		enum
+		{
+			SLICE_STEPS = 64 /**< steps to run an avatar before it can be moved to another thread */
+		};
+
+		AvatarRunner(unsigned int thread_num = 0);
+		~AvatarRunner();
+
+		void addAvatar(Avatar *avatar, unsigned long steps = 0);
+		unsigned long avatarNum() const;
+		void run();
+		void report() const;
+
+		unsigned int threadNum() const;
+		unsigned long totalSteps() const;
+		double elapsedTime() const;
+		unsigned long avatarSteps(unsigned long index) const;
+		double avatarTime(unsigned long index) const;
+		bool reachedDeadEnd(unsigned long index) const;
+
+	private:
+		unsigned int thread_num; /**< number of worker threads */
+		std::vector<struct ar_Task> tasks; /**< all avatars */
+		std::vector<struct ar_WorkQueue *> queues; /**< a queue for each worker */
+		std::atomic<unsigned long> remaining; /**< number of avatars not done yet */
+		std::mutex idle_mutex; /**< protect wakeups when idle workers wait on idle_cv */
+		std::condition_variable idle_cv; /**< signalled when an avatar is put back or all are done */
+		std::atomic<unsigned long> wakeups; /**< times idle_cv is signalled, an idle worker waits for it to change */
+		double elapsed; /**< wall time of the last run in seconds */
+
+		void workerLoop(unsigned int worker);
+		bool takeTask(unsigned int worker, unsigned long *task);
+		bool runSlice(struct ar_Task *task);
+		void wakeIdle(bool all);
+};
+
+}    // namespace gamcs
+
+#endif /* AVATARRUNNER_H_ */
@@ -16,21 +16,160 @@
 
 #ifndef CSOSAGENT_H_
 #define CSOSAGENT_H_
-#include <deque>
-#include <unordered_map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <unordered_set>
+#include <unordered_map>
 #include "gamcs/OSAgent.h"
+#include "gamcs/SlabPool.h"
+#include "gamcs/AdaptiveIndex.h"
+#include "gamcs/FlatStatesMap.h"
+#include "gamcs/SpscQueue.h"
+#include "gamcs/PayoffKernel.h"
+#include "gamcs/RWSpinLock.h"
 
 namespace gamcs
 {
 
+/**
+ * @brief The structure used to represent a state in computer memory
+ */
+struct cs_State
+{
+		Agent::State st; /**< the state value */
+		float payoff; /**< state payoff */
+		float committed_payoff; /**< payoff read by concurrent decisions, which differs from payoff only while changes are being propagated */
+		float original_payoff; /**< original payoff of the state */
+		uint32_t act_num; /**< number of actions in actlist */
+		unsigned long count; /**< experiencing count */
+		struct cs_Action *actlist; /**< performed actions under this state */
+		AdaptiveIndex<Agent::Action, struct cs_Action *> *actindex; /**< index of actlist, NULL until act_num exceeds ACT_INDEX_THRESHOLD */
+		struct cs_BackwardLink *blist; /**< which states have this state as their following state */
+		AdaptiveIndex<struct cs_State *, struct cs_BackwardLink *> *blkindex; /**< index of blist, NULL until blk_num exceeds BLK_INDEX_THRESHOLD */
+		uint32_t blk_num; /**< number of backward links in blist */
+		bool remote; /**< the state is owned by another memory shard, its payoff is only mirrored here */
+		unsigned long visit; /**< the last propagation epoch in which the state was updated */
+
+		struct cs_State *prev; /**< the previous state */
+		struct cs_State *next; /**< the next state */
+};
+
+// one is allocated for every state, so fields used by a single algorithm only are kept by the algorithm itself
+static_assert(sizeof(cs_State) <= 96, "cs_State has grown, make sure it's deliberate");
+
+/**
+ * @brief The structure used to represent an action in computer memory
+ */
+struct cs_Action
+{
+		Agent::Action act; /**< the action value */
+		unsigned long count; /**< sum of the counts of all environment actions in ealist */
+		struct cs_EnvAction *ealist; /**< observed environment actions under this action */
+
+		struct cs_Action *next; /**< the next action */
+};
+
+/**
+ * @brief The structure used to represent an environment action in computer memory
+ */
+struct cs_EnvAction
+{
+		Agent::EnvAction eat; /**< the action value */
+		unsigned long count; /**< experiencing count */
+		struct cs_State *nstate; /**< the following state of this action */
+
+		struct cs_EnvAction *next; /**< next environment action */
+};
+
+/**
+ * @brief The structure used to represent a link between a state and its up-streaming states
+ */
+struct cs_BackwardLink
+{
+		struct cs_State *pstate; /**< the up-streaming state */
+		struct cs_BackwardLink *prev; /**< previous backward link */
+		struct cs_BackwardLink *next; /**< next backward link */
+};
+
+/**
+ * @brief A state waiting in the priority queue of prioritized propagation
+ */
+struct cs_QueuedState
+{
+		float priority; /**< the priority, which is the estimated payoff change of the state */
+		struct cs_State *state; /**< the state */
+
+		/**
+		 * @brief Order queued states by priority.
+		 */
+		bool operator<(const cs_QueuedState &other) const
+		{
+			return priority < other.priority;
+		}
+};
+
+/**
+ * @brief A transition waiting to be learned by the learner thread
+ */
+struct cs_Transition
+{
+		Agent::State pst; /**< the previous state, INVALID_STATE if none */
+		Agent::Action pact; /**< the action performed under the previous state */
+		Agent::State st; /**< the current state */
+		float original_payoff; /**< original payoff of the current state */
+};
+
+/**
+ * @brief The immutable and contiguous representation of a memory used by a frozen agent.
+ *
+ * All data are stored as structure of arrays. States are sorted by value, the actions of
+ * state i are [act_start[i], act_start[i+1]) sorted by value, and the outcomes (environment actions) of
+ * action j are [eat_start[j], eat_start[j+1]).
+ */
+struct cs_CompiledMemory
+{
+		std::vector<Agent::State> states; /**< the state values, sorted */
+		std::vector<float> payoffs; /**< payoff of each state */
+		std::vector<uint32_t> act_start; /**< the first action of each state, with one more element at the end */
+		std::vector<Agent::Action> acts; /**< the action values */
+		std::vector<uint32_t> eat_start; /**< the first outcome of each action, with one more element at the end */
+		std::vector<float> eat_probs; /**< the probability of each outcome */
+		std::vector<uint32_t> eat_nstates; /**< the index of the following state of each outcome */
+};
+
+struct cs_SweepBarrier;
+
 /**
  * @brief CSOSAgent is an implementation of OSAgent using computer.
  */
 class CSOSAgent: public OSAgent
 {
 	public:
-		typedef std::unordered_map<Agent::State, void *> StatesMap; /**< hash mapping from state value to the address point stored that state */
+		typedef FlatStatesMap StatesMap; /**< hash mapping from state value to the address point stored that state */
+
+		/**
+		 * Thresholds of memory structures.
+		 */
+		enum
+		{
+			ACT_INDEX_THRESHOLD = 8, /**< a state with more actions than this will have its actions indexed */
+			BLK_INDEX_THRESHOLD = 8, /**< a state with more backward links than this will have its backward links indexed */
+			DEFAULT_LEARNER_QUEUE_SIZE = 4096, /**< default number of transitions that can wait for the learner thread */
+			DEFAULT_MAX_SWEEPS = 1000, /**< default maximum number of sweeps of a whole-memory recomputation */
+			MAX_SCC_ITERATIONS = 1000 /**< maximum number of iterations to solve a strongly connected component */
+		};
+
+		/**
+		 * Payoff propagation engines.
+		 */
+		enum Propagation
+		{
+			BREADTH_FIRST = 0, /**< update up-streaming states breadth-first until no payoff changes, this is the default */
+			PRIORITIZED /**< update states in order of their payoff changes within a budget per step, the rest is carried over to later steps */
+		};
 
 		CSOSAgent(int id = 0, float discount_rate = 0.9,
 				float accuracy = 0.01);
@@ -47,6 +186,9 @@ class CSOSAgent: public OSAgent
 		DEPRECATED("Be careful when used with a storage, currently states will not be deleted from storage, and this will lead to the storage inconsistent!\n")
 		void deleteState(State state);
 		void updatePayoff(State state);
+		unsigned long solvePayoff(State state);
+		unsigned long solveAllPayoffs();
+		float actionPayoff(State state, Action action) const;
 
 		struct Memory_Info *getMemoryInfo() const;
 		void addMemoryInfo(const struct Memory_Info *memory_info_header);
@@ -61,6 +203,36 @@ class CSOSAgent: public OSAgent
 		typedef void (*progbar_callback) (unsigned long index, unsigned total, char *label);
 		void loadMemoryFromStorage(Storage *specific_storage, progbar_callback progbar = NULL);
 		void dumpMemoryToStorage(Storage *specific_storage, progbar_callback progbar = NULL) const;
+		void dumpChangesToStorage(Storage *specific_storage, progbar_callback progbar = NULL) const;
+		unsigned long dirtyStateNum() const;
+		unsigned long deletedStateNum() const;
+
+		void getAllocationStats(unsigned long *node_allocs, unsigned long *slab_allocs) const;
+
+		void setPropagation(Propagation propagation,
+				unsigned long state_budget = 0, unsigned long time_budget = 0);
+		unsigned long pendingUpdates() const;
+		unsigned long updatedStateNum() const;
+		unsigned long recomputePayoffs(unsigned int thread_num = 0,
+				unsigned long max_sweeps = DEFAULT_MAX_SWEEPS);
+
+		void startLearner(unsigned long queue_size = DEFAULT_LEARNER_QUEUE_SIZE);
+		void stopLearner();
+		bool isLearnerRunning() const;
+
+		OSpace sharedBestActions(State state, OSpace &available_actions) const;
+		void sharedLearn(State previous_state, Action previous_action,
+				State state, float original_payoff);
+
+		bool mirrorState(State state, float payoff, bool propagate = true);
+		void sharedFlush();
+		bool isMirror(State state) const;
+		unsigned long mirrorNum() const;
+		void setChangeLog(std::vector<State> *change_log);
+
+		void freezeMemory();
+		void unfreezeMemory();
+		bool isFrozen() const;
 
 	private:
 		unsigned long state_num; /**< total number of states in memory */
@@ -71,17 +243,83 @@ class CSOSAgent: public OSAgent
 		mutable struct cs_State *cur_mst; /**< state structure for current state */
 		mutable struct cs_State *current_st_index; /**< current state address point used by iterator */
 
-		std::deque<cs_State *> update_queue; /**< the states to be updated */
-		std::unordered_set<cs_State *> visited_states; /**< the states that has been updated in an update circle */
+		std::vector<cs_State *> update_queue; /**< the states to be updated, reused by every propagation */
+		unsigned long queue_front; /**< position of the next state to be updated in update_queue */
+		unsigned long update_epoch; /**< the current propagation epoch, states updated in this epoch have visit equal to it */
+		unsigned long updated_state_num; /**< total number of state payoffs recalculated by propagations */
+		unsigned long mirror_num; /**< number of states mirrored from other memory shards */
+		std::vector<State> *change_log; /**< where to record states whose payoffs are changed by propagations, NULL if not recorded */
+
+		Propagation propagation; /**< the payoff propagation engine */
+		unsigned long state_budget; /**< maximum number of states updated per step by prioritized propagation, 0 for no limit */
+		unsigned long time_budget; /**< maximum microseconds spent per step by prioritized propagation, 0 for no limit */
+		std::vector<cs_QueuedState> priority_queue; /**< heap of states waiting to be updated by prioritized propagation, a state is queued once */
+		std::unordered_map<cs_State *, unsigned long> queue_positions; /**< position of each queued state in priority_queue */
+		std::vector<cs_State *> pending_states; /**< states to be updated when the current batch is flushed, which may be added more than once */
+
+		mutable std::unordered_set<cs_State *> dirty_states; /**< states changed since the memory was last dumped, only recorded when synced_storage is set */
+		mutable std::unordered_set<State> deleted_states; /**< states deleted since the memory was last dumped, only recorded when synced_storage is set */
+		mutable std::string synced_storage; /**< name of the storage which the memory was last dumped to or loaded from, empty if none */
+
+		SlabPool<cs_State> state_pool; /**< pool of state structures */
+		SlabPool<cs_Action> act_pool; /**< pool of action structures */
+		SlabPool<cs_EnvAction> eat_pool; /**< pool of environment action structures */
+		SlabPool<cs_BackwardLink> blk_pool; /**< pool of backward link structures */
+
+		SpscQueue<cs_Transition> *transitions; /**< transitions waiting for the learner thread, NULL if the learner is not running */
+		std::thread *learner; /**< the learner thread, NULL if not running */
+		std::atomic<bool> learner_stopping; /**< tell the learner thread to finish */
+		std::atomic<bool> learner_waiting; /**< the learner thread is waiting for transitions */
+		std::mutex learner_mutex; /**< used with learner_cv */
+		std::condition_variable learner_cv; /**< wake up the learner thread when transitions are queued */
+		std::mutex learning_mutex; /**< serialize learning and propagations between the learner thread and other writers */
+		mutable std::mutex memory_mutex; /**< guard links and committed payoffs read by decisions, held by writers only while linking or committing */
+		bool defer_commit; /**< payoff changes are committed for decisions by commitPayoffs() later, rather than at once */
+		std::vector<cs_State *> uncommitted; /**< states whose payoffs are changed but not committed for decisions, when commits are deferred */
+		mutable RWSpinLock shared_lock; /**< guard links and committed payoffs read by agent sessions, held exclusively only while linking or committing */
+
+		mutable struct cs_CompiledMemory *compiled; /**< the compiled memory when frozen, NULL if not frozen */
+		mutable bool compiled_stale; /**< whether the memory has been changed since compiled */
+		PayoffKernel kernel; /**< the vectorised kernel used to evaluate the compiled memory */
 
 		float prob(const struct cs_EnvAction *env_action,
 				const struct cs_Action *action) const;
 		OSpace bestActions(const struct cs_State *state,
-				OSpace &available_actions) const;
+				OSpace &available_actions, bool committed = false) const;
 		OSpace maxPayoffRule(Agent::State state,
 				OSpace &available_actions) const;
 		void updateStatePayoff(struct cs_State *state);
+		void beginPropagation();
+		void seedPropagation(struct cs_State *state);
+		void propagate();
+		unsigned long solveRegion();
+		unsigned long solveComponent(struct cs_State **states,
+				unsigned long num);
+		void sweepStates(const std::vector<cs_State *> &states,
+				std::vector<float> &new_payoffs, unsigned int thread_index,
+				unsigned int thread_num, unsigned long max_sweeps,
+				std::vector<float> &max_changes,
+				struct cs_SweepBarrier *barrier, unsigned long *sweeps);
+		void queueState(struct cs_State *state, float priority);
+		void sweepQueue(bool bounded = true);
+		void unqueueState(struct cs_State *state);
+		void siftQueueUp(unsigned long position);
+		void siftQueueDown(unsigned long position);
+		void placeQueued(unsigned long position, const struct cs_QueuedState &queued_state);
 		void updateMemory(float original_payoff);
+		struct cs_State *learnTransition(Agent::State previous_state,
+				Agent::Action previous_action, Agent::State state,
+				struct cs_State *mstate, float original_payoff);
+		void flushMemory();
+		void propagatePending();
+		void learnerLoop();
+		void commitPayoffs();
+		void addPending(struct cs_State *state);
+		void removePending(struct cs_State *state);
+		void compactPending();
+		void markDirty(struct cs_State *state);
+		void removeDirty(struct cs_State *state);
+		void clearDirty() const;
 
 		void loadState(Storage *storage, Agent::State state);
 
@@ -114,6 +352,8 @@ class CSOSAgent: public OSAgent
 		void freeEat(struct cs_EnvAction *env_action);
 		void freeBlk(struct cs_BackwardLink *backward_link);
 		void freeMemory();
+		void freeActIndex(struct cs_State *state);
+		void freeBlkIndex(struct cs_State *state);
 
 		void buildStateFromHeader(
 				const struct State_Info_Header *state_information_header,
@@ -122,56 +362,14 @@ class CSOSAgent: public OSAgent
 		float calStatePayoff(const struct cs_State *state) const;
 		float calActPayoff(Agent::Action action,
 				const struct cs_State *state) const;
-		float _calActPayoff(const struct cs_Action *action) const;
+		float _calActPayoff(const struct cs_Action *action,
+				bool committed = false) const;
 		float trimPayoff(float payoff) const;
-};
-
-/**
- * @brief The structure used to represent a state in computer memory
- */
-struct cs_State
-{
-		Agent::State st; /**< the state value */
-		float payoff; /**< state payoff */
-		float original_payoff; /**< original payoff of the state */
-		unsigned long count; /**< experiencing count */
-		struct cs_Action *actlist; /**< performed actions under this state */
-		struct cs_BackwardLink *blist; /**< which states have this state as their following state */
 
-		struct cs_State *prev; /**< the previous state */
-		struct cs_State *next; /**< the next state */
-};
-
-/**
- * @brief The structure used to represent an action in computer memory
- */
-struct cs_Action
-{
-		Agent::Action act; /**< the action value */
-		struct cs_EnvAction *ealist; /**< observed environment actions under this action */
-
-		struct cs_Action *next; /**< the next action */
-};
-
-/**
- * @brief The structure used to represent an environment action in computer memory
- */
-struct cs_EnvAction
-{
-		Agent::EnvAction eat; /**< the action value */
-		unsigned long count; /**< experiencing count */
-		struct cs_State *nstate; /**< the following state of this action */
-
-		struct cs_EnvAction *next; /**< next environment action */
-};
-
-/**
- * @brief The structure used to represent a link between a state and its up-streaming states
- */
-struct cs_BackwardLink
-{
-		struct cs_State *pstate; /**< the up-streaming state */
-		struct cs_BackwardLink *next; /**< next backward link */
+		void compileMemory() const;
+		long searchCompiledState(Agent::State state) const;
+		OSpace compiledBestActions(unsigned long state_index,
+				OSpace &available_actions) const;
 };
 
 }    // namespace gamcs
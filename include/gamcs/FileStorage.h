@@ -0,0 +1,131 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 30, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef FILESTORAGE_H_
+#define FILESTORAGE_H_
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "gamcs/Storage.h"
+
+namespace gamcs
+{
+
+#pragma pack(push)	// save default value
+#pragma pack(1)	// the same layout on all platforms
+
+/**
+ * @brief Header at the beginning of a snapshot file
+ */
+struct fs_FileHeader
+{
+		char magic[8]; /**< "GAMCSFS", with a terminating 0 */
+		uint32_t version; /**< version of the file format */
+		uint32_t state_bytes; /**< size of a state value, snapshots are not portable between different INT_BITS */
+		uint8_t has_memif; /**< whether memif is set */
+		struct Memory_Info memif; /**< the memory information */
+		uint64_t state_num; /**< number of states */
+		uint64_t index_offset; /**< where the state index starts in the file */
+};
+
+/**
+ * @brief An entry of the state index, which is sorted by state value
+ */
+struct fs_IndexEntry
+{
+		Agent::State st; /**< the state value */
+		uint64_t offset; /**< where the state information is in the file, 0 if the state is deleted */
+};
+
+#pragma pack(pop)	// pop saved default value
+
+/**
+ * @brief Storage on a binary snapshot file, which is mapped into memory for reading.
+ *
+ * The file holds a header, the state information blobs back to back, and a state index sorted by state value at the end.
+ * When opened for reading, getStateInfo() returns a pointer into the mapping without copying, which should be released by
+ * releaseStateInfo() and is valid until the storage is closed.
+ * When opened for writing, state information is appended sequentially to a new file, which replaces the old one
+ * with the unchanged states of it copied when the storage is closed. States written in this session are not indexed until then,
+ * and the iterator walks the states of the old file.
+ */
+class FileStorage: public Storage
+{
+	public:
+		/**
+		 * Versions of the file format.
+		 */
+		enum
+		{
+			FILE_VERSION = 1 /**< current version */
+		};
+
+		FileStorage(std::string file = "");
+		~FileStorage();
+
+		void setFile(std::string file);
+
+		int open(Flag flag);
+		void close();
+
+		Agent::State firstState() const;
+		Agent::State nextState() const;
+		bool hasState(Agent::State state) const;
+
+		struct State_Info_Header *getStateInfo(Agent::State state) const;
+		void releaseStateInfo(
+				struct State_Info_Header *state_information_header) const;
+		void addStateInfo(
+				const struct State_Info_Header *state_information_header);
+		void updateStateInfo(
+				const struct State_Info_Header *state_information_header);
+		void upsertStateInfo(
+				const struct State_Info_Header *state_information_header);
+		void deleteState(Agent::State state);
+
+		struct Memory_Info *getMemoryInfo() const;
+		void addMemoryInfo(const struct Memory_Info *memory_information_header);
+		void updateMemoryInfo(
+				const struct Memory_Info *memory_information_header);
+		std::string getMemoryName() const;
+
+	private:
+		std::string file_name; /**< the snapshot file */
+		Flag o_flag; /**< the open flag */
+		char *map; /**< mapping of the snapshot file, NULL if not mapped */
+		size_t map_size; /**< size of the mapping */
+		const struct fs_FileHeader *header; /**< header in the mapping */
+		const struct fs_IndexEntry *index; /**< state index in the mapping */
+		mutable unsigned long cursor; /**< position in index used by iterator */
+
+		FILE *out; /**< the new file being written, NULL if not in writing mode */
+		uint64_t out_offset; /**< where the next state information is written */
+		struct fs_FileHeader out_header; /**< header of the new file */
+		std::vector<struct fs_IndexEntry> written; /**< states written or deleted in this session, in the order of writing */
+		std::unordered_map<Agent::State, unsigned long> written_pos; /**< position of the last write of each state in written */
+
+		int mapFile();
+		bool checkFile() const;
+		void unmapFile();
+		long searchIndex(Agent::State state) const;
+		long searchWritten(Agent::State state) const;
+		void writeStateInfo(const struct State_Info_Header *sthd);
+		int commit();
+};
+
+}    // namespace gamcs
+#endif /* FILESTORAGE_H_ */
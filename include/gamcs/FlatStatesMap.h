@@ -0,0 +1,100 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 8, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef FLATSTATESMAP_H_
+#define FLATSTATESMAP_H_
+#include "gamcs/GIOM.h"
+#include "gamcs/AdaptiveIndex.h"
+
+namespace gamcs
+{
+
+/**
+ * @brief A flat open-addressing hash map from state values to non-NULL addresses.
+ *
+ * All entries are stored in a single array, so no allocation happens per state and a lookup
+ * usually touches one cache line. Keys are mixed by hashMix() before probing, which keeps
+ * encoded states with regular patterns from clustering. Deletion shifts the following entries
+ * backward instead of leaving tombstones.
+ */
+class FlatStatesMap
+{
+	public:
+		typedef gamcs_int Key; /**< the key type, same as state */
+
+		FlatStatesMap();
+		~FlatStatesMap();
+
+		/**
+		 * @brief Find the value of a key.
+		 *
+		 * @param [in] key the key
+		 * @return the value, or NULL if not found
+		 */
+		void *find(Key key) const
+		{
+			if (entries == NULL)
+				return NULL;
+
+			unsigned long i = hashMix((uint64_t) key) & mask;
+			while (entries[i].val != NULL)
+			{
+				if (entries[i].key == key)
+					return entries[i].val;
+				i = (i + 1) & mask;
+			}
+			return NULL;
+		}
+
+		void insert(Key key, void *val);
+		void erase(Key key);
+		void clear();
+		void reserve(unsigned long num);
+
+		/**
+		 * @brief Get the number of entries.
+		 *
+		 * @return the number
+		 */
+		unsigned long size() const
+		{
+			return entry_num;
+		}
+
+	private:
+		/**
+		 * @brief A map entry.
+		 */
+		struct Entry
+		{
+				Key key; /**< the key */
+				void *val; /**< the value, NULL for an empty slot */
+		};
+
+		Entry *entries; /**< the slots */
+		unsigned long capacity; /**< number of slots, always a power of 2 */
+		unsigned long mask; /**< capacity - 1 */
+		unsigned long entry_num; /**< number of entries */
+
+		void rehash(unsigned long ncap);
+
+		FlatStatesMap(const FlatStatesMap &); /**< not copyable */
+		FlatStatesMap &operator=(const FlatStatesMap &); /**< not copyable */
+};
+
+}    // namespace gamcs
+
+#endif /* FLATSTATESMAP_H_ */
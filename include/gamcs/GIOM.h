@@ -17,6 +17,7 @@
 #ifndef GIOM_H
 #define GIOM_H
 #include <stddef.h>     // NULL
+#include <utility>      // std::move
 #define __STDC_LIMIT_MACROS     // UINT64_MAX
 #include <cstdint>
 #define __STDC_FORMAT_MACROS    // PRIu64
@@ -92,6 +93,16 @@ class GIOM
 		typedef gamcs_int Input; /**< Input type (signed integer) <br> Print: @code printf("%" IN_FMT "\n", input); @endcode */
 		typedef gamcs_int Output; /**< Output type (signed integer) <br> Print:  @code printf("%" OUT_FMT "\n", output); @endcode */
 
+		/**
+		 * Random number engines used to choose outputs.
+		 */
+		enum RandomEngine
+		{
+			XOSHIRO256PP = 0, /**< xoshiro256++, fast with a period of 2^256-1, the default */
+			PCG32, /**< PCG32 (XSH RR), a small state and a stream selected by the seed */
+			RANDOM_DEVICE /**< std::random_device, true random but slow, and can't be seeded */
+		};
+
 		GIOM();
 		virtual ~GIOM();
 
@@ -99,6 +110,11 @@ class GIOM
 		float singleOutputEntropy(Input input, OSpace &available_outputs) const;
 		virtual void update();
 
+		void setRandomEngine(RandomEngine engine);
+		RandomEngine getRandomEngine() const;
+		void setSeed(uint64_t seed);
+		uint64_t getSeed() const;
+
 		static const Input INVALID_INPUT = GAMCS_INT_MAX; /**< the maximum value is used to indicate an invalid input */
 		static const Output INVALID_OUTPUT = GAMCS_INT_MAX; /**< the maximum value is used to indicate an invalid output */
 
@@ -109,9 +125,15 @@ class GIOM
 		unsigned long process_count; /**< processing counts */
 
 	private:
-		std::random_device *rand_device; /**< random-generating engine */
+		std::random_device *rand_device; /**< random-generating device, used for seeding and by RANDOM_DEVICE */
 		unsigned long max_rand_value; /**< maximum random value possibly generated by rand_device */
+		RandomEngine rand_engine; /**< the engine in use */
+		uint64_t rand_seed; /**< seed of the engine */
+		mutable uint64_t rand_state[4]; /**< state of the engine, each GIOM has its own stream */
 		gamcs_uint randomGenerator(gamcs_uint size) const;
+		void seedEngine();
+		uint64_t nextRandom64() const;
+		uint32_t nextRandom32() const;
 };
 
 /**
@@ -124,6 +146,7 @@ struct OFragment
 		GIOM::Output start; /**< the starting output */
 		GIOM::Output end; /**< the ending output, for a single output, the ending is equal to the starting. */
 		GIOM::Output step; /**< the increasing or decreasing step */
+		gamcs_uint offset; /**< number of outputs in the fragments before this one, used to locate an index by binary search */
 };
 
 /**
@@ -138,11 +161,12 @@ class OSpace
 {
 	public:
 		/**
-		 * The spare capacity.
+		 * The spare and inline capacities.
 		 */
 		enum
 		{
-			SPARE_CAPACITY = 5 /**< SPARE_CAPACITY */
+			SPARE_CAPACITY = 5, /**< SPARE_CAPACITY */
+			INLINE_CAPACITY = 8 /**< fragments stored inside the object, no heap allocation is needed for spaces within it */
 		};
 
 		typedef gamcs_uint ossize_t; /**< output space size type */
@@ -153,10 +177,15 @@ class OSpace
 		 * @param [in] initfn the initial number of fragments
 		 */
 		explicit OSpace(ossize_t initfn = 0) :
-				frag_num(initfn), the_capacity(initfn + SPARE_CAPACITY), output_num(
-						0), current_index(0), outputs(NULL)
+				frag_num(initfn), the_capacity(INLINE_CAPACITY), output_num(0), current_index(
+						0), current_frag(0), current_output(GIOM::INVALID_OUTPUT), outputs(
+						inline_frags)
 		{
-			outputs = new OFragment[the_capacity];
+			if (initfn + SPARE_CAPACITY > INLINE_CAPACITY)
+			{
+				the_capacity = initfn + SPARE_CAPACITY;
+				outputs = new OFragment[the_capacity];
+			}
 		}
 
 		/**
@@ -165,18 +194,33 @@ class OSpace
 		 * @param [in] other another OSpace object
 		 */
 		OSpace(const OSpace &other) :
-				frag_num(0), the_capacity(SPARE_CAPACITY), output_num(0), current_index(
-						0), outputs(NULL)
+				frag_num(0), the_capacity(INLINE_CAPACITY), output_num(0), current_index(
+						0), current_frag(0), current_output(GIOM::INVALID_OUTPUT), outputs(
+						inline_frags)
 		{
 			operator=(other);
 		}
 
+		/**
+		 * @brief The move constructor, takes over the fragments of other without copying if they are on the heap.
+		 *
+		 * @param [in] other another OSpace object, which is left empty
+		 */
+		OSpace(OSpace &&other) :
+				frag_num(0), the_capacity(INLINE_CAPACITY), output_num(0), current_index(
+						0), current_frag(0), current_output(GIOM::INVALID_OUTPUT), outputs(
+						inline_frags)
+		{
+			operator=(std::move(other));
+		}
+
 		/**
 		 * @brief The default destructor.
 		 */
 		~OSpace()
 		{
-			delete[] outputs;
+			if (outputs != inline_frags)
+				delete[] outputs;
 		}
 
 		/**
@@ -209,6 +253,41 @@ class OSpace
 			return the_capacity;
 		}
 
+		/**
+		 * @brief Get the number of fragments in the space.
+		 *
+		 * @return the number
+		 */
+		ossize_t fragmentNum() const
+		{
+			return frag_num;
+		}
+
+		/**
+		 * @brief Get a fragment of the space, fragments are in the order of outputs.
+		 *
+		 * @param [in] index the fragment index (starting from 0), must be less than fragmentNum()
+		 * @return the fragment
+		 */
+		const OFragment &fragment(ossize_t index) const
+		{
+			return outputs[index];
+		}
+
+		/**
+		 * @brief Get the number of outputs in a fragment.
+		 *
+		 * @param [in] index the fragment index (starting from 0), must be less than fragmentNum()
+		 * @return the number
+		 */
+		ossize_t fragmentSize(ossize_t index) const
+		{
+			if (index + 1 < frag_num)
+				return outputs[index + 1].offset - outputs[index].offset;
+			else
+				return output_num - outputs[index].offset;
+		}
+
 		/**
 		 * @brief Override operator [].
 		 *
@@ -218,37 +297,24 @@ class OSpace
 		 */
 		GIOM::Output operator[](ossize_t index) const
 		{
-			ossize_t total_num = 0;
-			ossize_t out_wanted;
-
-			if (index < total_num)    // subscript out of bound
+			if (index >= output_num)    // superscript out of bound
 			{
 				return GIOM::INVALID_OUTPUT;
 			}
 
-			ossize_t i;
-			// traverse each fragment to find which fragment the index locates in
-			for (i = 0; i < frag_num; i++)
-			{
-				OFragment *ptr = outputs + i;
-				ossize_t out_num_in_this_frag = (ptr->end - ptr->start)
-						/ ptr->step + 1;
-				if (total_num + out_num_in_this_frag > index)    // index is in this fragment
-				{
-					ossize_t index_in_frag = index - total_num;
-					out_wanted = ptr->start + ptr->step * index_in_frag;
-					break;
-				}
-
-				total_num += out_num_in_this_frag;
-			}
-
-			if (i >= frag_num)    // superscript out of bound
+			// binary search for the last fragment starting at or before the index
+			ossize_t lo = 0, hi = frag_num - 1;
+			while (lo < hi)
 			{
-				return GIOM::INVALID_OUTPUT;
+				ossize_t mid = lo + (hi - lo + 1) / 2;
+				if (outputs[mid].offset <= index)
+					lo = mid;
+				else
+					hi = mid - 1;
 			}
 
-			return out_wanted;
+			OFragment *ptr = outputs + lo;
+			return ptr->start + ptr->step * (GIOM::Output) (index - ptr->offset);
 		}
 
 		/**
@@ -261,20 +327,61 @@ class OSpace
 		{
 			if (this != &other)
 			{
-				delete[] outputs;
+				frag_num = 0;    // nothing to keep when expanding
+				if (other.frag_num > the_capacity)    // reuse the current storage if it's enough
+					expand(other.frag_num);
+
 				// copy data
 				frag_num = other.frag_num;
-				the_capacity = other.the_capacity;
 				output_num = other.output_num;
 
-				outputs = new OFragment[the_capacity];
 				// copy each fragment
 				for (ossize_t i = 0; i < frag_num; i++)
 				{
 					outputs[i] = other.outputs[i];
 				}
+
+				// the cursor of the old space means nothing in the new one
+				current_index = 0;
+				current_frag = 0;
+				current_output = GIOM::INVALID_OUTPUT;
+			}
+
+			return *this;
+		}
+
+		/**
+		 * @brief The move assignment, takes over the fragments of other without copying if they are on the heap.
+		 *
+		 * @param [in] other another OSpace object, which is left empty
+		 * @return the reassigned object
+		 */
+		const OSpace &operator=(OSpace &&other)
+		{
+			if (this == &other)
+				return *this;
+
+			if (other.outputs == other.inline_frags)    // inline fragments can't be taken over, copy them
+			{
+				operator=((const OSpace &) other);
+			}
+			else
+			{
+				if (outputs != inline_frags)
+					delete[] outputs;
+				outputs = other.outputs;
+				the_capacity = other.the_capacity;
+				frag_num = other.frag_num;
+				output_num = other.output_num;
+				current_index = 0;
+				current_frag = 0;
+				current_output = GIOM::INVALID_OUTPUT;
+
+				other.outputs = other.inline_frags;
+				other.the_capacity = INLINE_CAPACITY;
 			}
 
+			other.clear();
 			return *this;
 		}
 
@@ -285,6 +392,20 @@ class OSpace
 		 */
 		void add(GIOM::Output output)
 		{
+			// extend the last fragment if the output follows it, which keeps ties of consecutive outputs in one fragment
+			if (frag_num > 0)
+			{
+				OFragment *last = outputs + frag_num - 1;
+				if (last->step == 1 && last->end >= last->start
+						&& last->end != GIOM::INVALID_OUTPUT
+						&& output == last->end + 1)
+				{
+					last->end = output;
+					++output_num;
+					return;
+				}
+			}
+
 			// check if exceeds the capacity
 			if (frag_num == the_capacity)
 				expand(2 * the_capacity + 1);
@@ -293,6 +414,7 @@ class OSpace
 			new_frag.start = output;
 			new_frag.end = output;
 			new_frag.step = 1;
+			new_frag.offset = output_num;
 			outputs[frag_num++] = new_frag;    // copy fragment and increase num
 			++output_num;
 		}
@@ -319,6 +441,7 @@ class OSpace
 			new_frag.start = start;
 			new_frag.end = end;
 			new_frag.step = step;
+			new_frag.offset = output_num;
 			outputs[frag_num++] = new_frag;
 			output_num += (end - start) / step + 1;
 		}
@@ -344,7 +467,8 @@ class OSpace
 			}
 
 			the_capacity = ncap;
-			delete[] old_list;
+			if (old_list != inline_frags)
+				delete[] old_list;
 		}
 
 		/**
@@ -355,6 +479,8 @@ class OSpace
 			frag_num = 0;
 			output_num = 0;
 			current_index = 0;
+			current_frag = 0;
+			current_output = GIOM::INVALID_OUTPUT;
 		}
 
 		/**
@@ -365,7 +491,12 @@ class OSpace
 		GIOM::Output first() const
 		{
 			current_index = 0;
-			return operator[](current_index);
+			current_frag = 0;
+			if (output_num == 0)
+				current_output = GIOM::INVALID_OUTPUT;
+			else
+				current_output = outputs[0].start;
+			return current_output;
 		}
 
 		/**
@@ -385,8 +516,18 @@ class OSpace
 		 */
 		GIOM::Output next() const
 		{
+			if (current_index >= output_num)    // reach the end already
+				return GIOM::INVALID_OUTPUT;
+
 			current_index++;
-			return operator[](current_index);
+			if (current_index >= output_num)
+				current_output = GIOM::INVALID_OUTPUT;
+			else if (current_frag + 1 < frag_num
+					&& outputs[current_frag + 1].offset == current_index)    // move to the next fragment
+				current_output = outputs[++current_frag].start;
+			else
+				current_output += outputs[current_frag].step;
+			return current_output;
 		}
 
 	private:
@@ -394,7 +535,10 @@ class OSpace
 		ossize_t the_capacity; /**< the space capacity */
 		ossize_t output_num; /**< the number of outputs */
 		mutable ossize_t current_index; /**< the index used by iterator */
-		OFragment *outputs; /**< OFragments used to store outputs*/
+		mutable ossize_t current_frag; /**< the fragment where current_index locates */
+		mutable GIOM::Output current_output; /**< the output at current_index */
+		OFragment *outputs; /**< OFragments used to store outputs, points to inline_frags or the heap */
+		OFragment inline_frags[INLINE_CAPACITY]; /**< inline storage for small spaces */
 };
 
 }    // namespace gamcs
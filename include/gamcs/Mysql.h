@@ -51,6 +51,8 @@ class Mysql: public Storage
 				const struct State_Info_Header *state_information_header);
 		void updateStateInfo(
 				const struct State_Info_Header *state_information_header);
+		void upsertStateInfo(
+				const struct State_Info_Header *state_information_header);
 		DEPRECATED("This function is not completely supported yet and will easily lead to storage inconsistent!\n")
 		void deleteState(Agent::State state);
 
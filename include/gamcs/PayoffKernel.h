@@ -0,0 +1,78 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 16, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef PAYOFFKERNEL_H_
+#define PAYOFFKERNEL_H_
+#include <cstdint>
+
+namespace gamcs
+{
+
+/**
+ * @brief Vectorised kernels for payoff evaluation over contiguous outcome arrays.
+ *
+ * Each action is computed by its own SIMD lane, and outcomes of an action are summed in their
+ * stored order, exactly as the scalar loop does. So the results are bit-for-bit the same as
+ * the scalar path no matter which instruction set is used.
+ */
+class PayoffKernel
+{
+	public:
+		/**
+		 * Instruction sets of the kernels.
+		 */
+		enum Isa
+		{
+			SCALAR = 0, /**< plain C++ loops, always available */
+			AVX2, /**< 8 lanes with AVX2 */
+			BEST /**< the best one supported by current CPU */
+		};
+
+		explicit PayoffKernel(Isa isa = BEST);
+
+		Isa getIsa() const;
+		static bool isSupported(Isa isa);
+
+		/**
+		 * @brief Calculate the untrimmed expected payoff of consecutive actions.
+		 *
+		 * The outcomes of action j are [eat_start[j], eat_start[j+1]), outcome k happens with probability probs[k]
+		 * and leads to the state whose payoff is payoffs[nstates[k]].
+		 * @param [in] eat_start the first outcome of each action, with one more element at the end
+		 * @param [in] act_num number of actions
+		 * @param [in] probs probability of each outcome
+		 * @param [in] nstates following state index of each outcome
+		 * @param [in] payoffs payoff of each state
+		 * @param [out] out expected payoff of each action
+		 */
+		void actionPayoffs(const uint32_t *eat_start, unsigned long act_num,
+				const float *probs, const uint32_t *nstates,
+				const float *payoffs, float *out) const
+		{
+			act_kernel(eat_start, act_num, probs, nstates, payoffs, out);
+		}
+
+	private:
+		typedef void (*ActKernel)(const uint32_t *, unsigned long,
+				const float *, const uint32_t *, const float *, float *); /**< kernel of actionPayoffs() */
+
+		Isa isa; /**< the instruction set in use */
+		ActKernel act_kernel; /**< the kernel of actionPayoffs() */
+};
+
+}    // namespace gamcs
+
+#endif /* PAYOFFKERNEL_H_ */
@@ -0,0 +1,116 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 20, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef RWSPINLOCK_H_
+#define RWSPINLOCK_H_
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+namespace gamcs
+{
+
+/**
+ * @brief A readers-writer spin lock built on a single atomic word.
+ *
+ * Readers only do an atomic increment and decrement when no writer is around, so reads never block each other.
+ * A waiting writer stops new readers from entering, so writers won't starve.
+ * Threads yield after spinning for a while, in case there are more threads than cores.
+ */
+class RWSpinLock
+{
+	public:
+		/**
+		 * @brief The default constructor.
+		 */
+		RWSpinLock() :
+				word(0)
+		{
+		}
+
+		/**
+		 * @brief Acquire the lock for reading.
+		 */
+		void lockShared()
+		{
+			for (unsigned long spins = 0;; spins++)
+			{
+				uint32_t w = word.load(std::memory_order_relaxed);
+				if ((w & WRITER) == 0
+						&& word.compare_exchange_weak(w, w + 1,
+								std::memory_order_acquire))
+					return;
+				pause(spins);
+			}
+		}
+
+		/**
+		 * @brief Release the lock for reading.
+		 */
+		void unlockShared()
+		{
+			word.fetch_sub(1, std::memory_order_release);
+		}
+
+		/**
+		 * @brief Acquire the lock for writing.
+		 */
+		void lock()
+		{
+			unsigned long spins = 0;
+			for (;; spins++)    // claim the writer bit first
+			{
+				uint32_t w = word.load(std::memory_order_relaxed);
+				if ((w & WRITER) == 0
+						&& word.compare_exchange_weak(w, w | WRITER,
+								std::memory_order_acquire))
+					break;
+				pause(spins);
+			}
+
+			while (word.load(std::memory_order_acquire) != WRITER)    // wait for readers to leave
+				pause(spins++);
+		}
+
+		/**
+		 * @brief Release the lock for writing.
+		 */
+		void unlock()
+		{
+			word.store(0, std::memory_order_release);
+		}
+
+	private:
+		static const uint32_t WRITER = 0x80000000; /**< the writer bit, the other bits count readers */
+
+		std::atomic<uint32_t> word; /**< the lock word */
+
+		/**
+		 * @brief Wait a moment before trying again.
+		 */
+		static void pause(unsigned long spins)
+		{
+			if (spins > 64)
+				std::this_thread::yield();
+		}
+
+		RWSpinLock(const RWSpinLock &); /**< not copyable */
+		RWSpinLock &operator=(const RWSpinLock &); /**< not copyable */
+};
+
+}    // namespace gamcs
+
+#endif /* RWSPINLOCK_H_ */
@@ -0,0 +1,178 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 23, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef SHARDEDAGENT_H_
+#define SHARDEDAGENT_H_
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "gamcs/CSOSAgent.h"
+
+namespace gamcs
+{
+
+/**
+ * @brief A message sent to a shard worker
+ */
+struct sd_Message
+{
+		int type; /**< the message type, see ShardedAgent::MessageType */
+		Agent::State st; /**< the state concerned */
+		Agent::Action act; /**< the action concerned */
+		Agent::State nst; /**< the following state concerned */
+		float payoff; /**< a payoff value */
+		int from; /**< the sending shard */
+		unsigned long wave; /**< the propagation wave which the message belongs to */
+		struct State_Info_Header *sthd; /**< a state information to be loaded, owned by the message until released to storage */
+		Storage *storage; /**< a storage to be dumped to, or which sthd is got from */
+};
+
+/**
+ * @brief A memory shard with its own worker thread
+ */
+struct sd_Shard
+{
+		CSOSAgent *memory; /**< the memory of the shard, which has its own states map and allocators */
+		std::thread *worker; /**< the worker thread */
+		std::mutex mutex; /**< protect the inbox */
+		std::condition_variable cv; /**< wake up the worker */
+		std::deque<sd_Message> inbox; /**< messages to be handled */
+		std::unordered_map<Agent::State, uint64_t> subscribers; /**< owned states mirrored by other shards, as bit sets of shards */
+		std::unordered_map<Agent::State, unsigned long> mirror_waves; /**< the latest wave in which each mirror has propagated its change */
+		bool waiting; /**< changes of mirrors new in their waves are waiting for the end of the current run of mirror messages */
+		bool deferred; /**< changes of mirrors already propagated in their waves are waiting for the next propagation */
+		unsigned long mirror_changes; /**< number of payoff changes of mirrors */
+		std::vector<Agent::State> changed; /**< states whose payoffs are changed by the last message */
+};
+
+/**
+ * @brief An agent whose memory is partitioned by state hash across shards, each of which is updated by its own worker thread.
+ *
+ * A state is owned by exactly one shard. A link to a state of another shard is built to a mirror of that state,
+ * whose payoff is pushed by the owner shard as messages whenever it changes, so backward propagation crosses
+ * shards as messages between workers. Decisions are made by the owner shard of the state without blocking workers.
+ *
+ * Every transition or update sent to shards starts a new wave, and messages caused by it carry its number.
+ * A mirror always takes the latest payoff of its owner, but it starts a propagation only once in a wave,
+ * and never for a wave older than the last one it has propagated in. A further change in the same wave waits
+ * in the batch of the shard until the next propagation there, or until the next flush starts a wave to propagate it.
+ * So propagations over cycles across shards always end, even if the accuracy is 0. Changes of a run of mirror
+ * messages in the inbox are propagated together, so a state is updated once for all of them.
+ *
+ * Learning is asynchronous, flush() waits until all shards are idle. So the batch size is 0 by default,
+ * set a positive one to have learning synchronized every some steps.
+ *
+ * It can also be shared by avatars through agent sessions. A session only sends its transitions to the owner shards,
+ * so sessions never wait for each other to learn, and every state range is learned by the single worker owning it.
+ */
+class ShardedAgent: public OSAgent
+{
+	public:
+		/**
+		 * Limits of shards.
+		 */
+		enum
+		{
+			MAX_SHARD_NUM = 64 /**< maximum number of shards */
+		};
+
+		ShardedAgent(int id = 0, float discount_rate = 0.9,
+				float accuracy = 0.01, int shard_num = 4);
+		~ShardedAgent();
+
+		int open(Flag flag);
+		void close();
+
+		State_Info_Header *getStateInfo(State state) const;
+		void addStateInfo(
+				const struct State_Info_Header * state_information_header);
+		void updateStateInfo(
+				const struct State_Info_Header *state_information_header);
+		void deleteState(State state);
+		void updatePayoff(State state);
+
+		struct Memory_Info *getMemoryInfo() const;
+		void addMemoryInfo(const struct Memory_Info *memory_info_header);
+		void updateMemoryInfo(const struct Memory_Info *memory_info_header);
+		std::string getMemoryName() const;
+
+		// iterator
+		State firstState() const;
+		State nextState() const;
+		bool hasState(State state) const;
+
+		void loadMemoryFromStorage(Storage *specific_storage);
+		void dumpMemoryToStorage(Storage *specific_storage) const;
+
+		int shardNum() const;
+		int shardOf(State state) const;
+		unsigned long staleMirrorNum() const;
+		unsigned long recomputePayoffs(unsigned long max_rounds =
+				CSOSAgent::DEFAULT_MAX_SWEEPS);
+
+		OSpace sharedBestActions(State state, OSpace &available_actions) const;
+		void sharedLearn(State previous_state, Action previous_action,
+				State state, float original_payoff);
+
+		/**
+		 * Types of messages between shards.
+		 */
+		enum MessageType
+		{
+			MSG_VISIT = 0, /**< the owned state st is visited with original payoff */
+			MSG_LINK, /**< learn the transition from the owned state st by act to nst with original payoff */
+			MSG_SUBSCRIBE, /**< shard from mirrors the owned state st */
+			MSG_MIRROR, /**< payoff of the mirrored state st is changed */
+			MSG_UPDATE, /**< update payoffs starting from the owned state st */
+			MSG_LOAD, /**< load the state information sthd */
+			MSG_ATTACH, /**< mirror all states owned by other shards */
+			MSG_DUMP, /**< dump all owned states to storage */
+			MSG_FLUSH, /**< propagate the deferred changes of mirrors */
+			MSG_RECOMPUTE, /**< recalculate payoffs of all owned states until they converge */
+			MSG_STOP /**< stop the worker */
+		};
+
+	protected:
+		OSpace maxPayoffRule(State state, OSpace &available_actions) const;
+		void updateMemory(float original_payoff);
+		void flushMemory();
+
+	private:
+		int shard_num; /**< number of shards */
+		std::vector<sd_Shard *> shards; /**< the shards */
+		mutable std::mutex idle_mutex; /**< protect outstanding */
+		mutable std::condition_variable idle_cv; /**< wake up threads waiting for all shards to be idle */
+		mutable unsigned long outstanding; /**< number of messages sent but not handled yet */
+		mutable std::mutex storage_mutex; /**< serialize storage accesses of shards when dumping */
+		mutable int current_shard; /**< current shard used by iterator */
+		std::atomic<unsigned long> wave; /**< number of the latest wave, started by the caller or agent sessions */
+
+		void post(int shard, const sd_Message &message) const;
+		void waitIdle() const;
+		void workerLoop(int shard);
+		void handle(int shard, sd_Message &message);
+		void attachMirrors(int shard, unsigned long wave);
+		void dumpShard(int shard, Storage *storage);
+		void publishChanges(int shard, unsigned long wave);
+};
+
+}    // namespace gamcs
+
+#endif /* SHARDEDAGENT_H_ */
@@ -0,0 +1,183 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 3, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef SLABPOOL_H_
+#define SLABPOOL_H_
+#include <stdlib.h>
+#include <assert.h>
+
+namespace gamcs
+{
+
+/**
+ * @brief A typed slab allocator for fixed-size memory nodes.
+ *
+ * Nodes are carved out of large slabs instead of being malloc'ed one by one.
+ * Released nodes are kept in a free list and reused by later allocations,
+ * and all slabs can be returned to the system at once by clear().
+ *
+ * Note that constructors and destructors of T are NOT called, T is expected to be a plain struct.
+ */
+template<typename T>
+class SlabPool
+{
+	public:
+		/**
+		 * The default number of nodes in a slab.
+		 */
+		enum
+		{
+			DEFAULT_SLAB_SIZE = 1024 /**< DEFAULT_SLAB_SIZE */
+		};
+
+		/**
+		 * @brief The default constructor.
+		 *
+		 * @param [in] ss number of nodes in each slab
+		 */
+		explicit SlabPool(unsigned long ss = DEFAULT_SLAB_SIZE) :
+				slab_size(ss), slabs(NULL), free_list(NULL), bump(NULL), bump_end(
+				NULL), node_num(0), slab_num(0)
+		{
+			assert(slab_size > 0);
+		}
+
+		/**
+		 * @brief The default destructor.
+		 */
+		~SlabPool()
+		{
+			clear();
+		}
+
+		/**
+		 * @brief Allocate a node from the pool.
+		 *
+		 * @return address pointer of the node, the content is uninitialized
+		 */
+		T *alloc()
+		{
+			Node *nd;
+			if (free_list != NULL)    // reuse a released node first
+			{
+				nd = free_list;
+				free_list = nd->next;
+			}
+			else
+			{
+				if (bump == bump_end)    // current slab is used up
+					newSlab();
+				nd = bump++;
+			}
+
+			++node_num;
+			return &nd->obj;
+		}
+
+		/**
+		 * @brief Release a node back to the pool for reusing.
+		 *
+		 * @param [in] obj the node to be released, which must be allocated from this pool
+		 */
+		void release(T *obj)
+		{
+			if (obj == NULL)
+				return;
+
+			Node *nd = (Node *) obj;
+			nd->next = free_list;
+			free_list = nd;
+		}
+
+		/**
+		 * @brief Free all slabs at once, every node allocated from the pool becomes invalid.
+		 */
+		void clear()
+		{
+			Node *sl, *nsl;
+			for (sl = slabs; sl != NULL; sl = nsl)
+			{
+				nsl = sl->next;    // the first node of each slab links to the next slab
+				free(sl);
+			}
+
+			slabs = NULL;
+			free_list = NULL;
+			bump = NULL;
+			bump_end = NULL;
+		}
+
+		/**
+		 * @brief Get the total number of nodes handed out since creation.
+		 *
+		 * It equals to the number of malloc calls needed without pooling.
+		 * @return the number
+		 */
+		unsigned long nodeNum() const
+		{
+			return node_num;
+		}
+
+		/**
+		 * @brief Get the total number of slabs allocated since creation.
+		 *
+		 * @return the number
+		 */
+		unsigned long slabNum() const
+		{
+			return slab_num;
+		}
+
+	private:
+		/**
+		 * @brief A node is either in use as T, or linked in the free list.
+		 */
+		union Node
+		{
+				Node *next; /**< next node in free list, or next slab for the slab header */
+				T obj; /**< the stored object */
+		};
+
+		unsigned long slab_size; /**< number of nodes in each slab */
+		Node *slabs; /**< the chain of allocated slabs */
+		Node *free_list; /**< the released nodes */
+		Node *bump; /**< the next unused node in current slab */
+		Node *bump_end; /**< the end of current slab */
+		unsigned long node_num; /**< total number of nodes handed out */
+		unsigned long slab_num; /**< total number of slabs allocated */
+
+		/**
+		 * @brief Allocate a new slab and make it the current one.
+		 */
+		void newSlab()
+		{
+			Node *sl = (Node *) malloc((slab_size + 1) * sizeof(Node));    // one more node as the slab header
+			assert(sl != NULL);
+			sl->next = slabs;
+			slabs = sl;
+
+			bump = sl + 1;
+			bump_end = sl + 1 + slab_size;
+			++slab_num;
+		}
+
+		SlabPool(const SlabPool &); /**< not copyable */
+		SlabPool &operator=(const SlabPool &); /**< not copyable */
+};
+
+}    // namespace gamcs
+
+#endif /* SLABPOOL_H_ */
@@ -0,0 +1,121 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 12, 2014
+//
+// -----------------------------------------------------------------------------
+
+#ifndef SPSCQUEUE_H_
+#define SPSCQUEUE_H_
+#include <stdlib.h>
+#include <assert.h>
+#include <atomic>
+
+namespace gamcs
+{
+
+/**
+ * @brief A bounded lock-free queue for exactly one producer thread and one consumer thread.
+ *
+ * Elements are kept in a ring buffer whose capacity is a power of 2. The producer only writes the tail
+ * and the consumer only writes the head, so no locks or compare-and-swap are needed.
+ *
+ * Note that T is copied by assignment, it's expected to be a plain struct.
+ */
+template<typename T>
+class SpscQueue
+{
+	public:
+		/**
+		 * @brief The default constructor.
+		 *
+		 * @param [in] cap the minimum capacity, which will be rounded up to a power of 2
+		 */
+		explicit SpscQueue(unsigned long cap) :
+				buffer(NULL), mask(0), head(0), tail(0)
+		{
+			unsigned long ncap = 2;
+			while (ncap < cap)
+				ncap *= 2;
+			mask = ncap - 1;
+
+			buffer = (T *) malloc(ncap * sizeof(T));
+			assert(buffer != NULL);
+		}
+
+		/**
+		 * @brief The default destructor.
+		 */
+		~SpscQueue()
+		{
+			free(buffer);
+		}
+
+		/**
+		 * @brief Append an element, called by the producer only.
+		 *
+		 * @param [in] elem the element
+		 * @return true on success, false if the queue is full
+		 */
+		bool push(const T &elem)
+		{
+			unsigned long t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) > mask)    // full
+				return false;
+
+			buffer[t & mask] = elem;
+			tail.store(t + 1, std::memory_order_release);    // publish the element
+			return true;
+		}
+
+		/**
+		 * @brief Take the element at front, called by the consumer only.
+		 *
+		 * @param [out] elem the element
+		 * @return true on success, false if the queue is empty
+		 */
+		bool pop(T &elem)
+		{
+			unsigned long h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire))    // empty
+				return false;
+
+			elem = buffer[h & mask];
+			head.store(h + 1, std::memory_order_release);    // release the slot to producer
+			return true;
+		}
+
+		/**
+		 * @brief Check if the queue is empty.
+		 *
+		 * @return true if empty, false otherwise
+		 */
+		bool empty() const
+		{
+			return head.load(std::memory_order_acquire)
+					== tail.load(std::memory_order_acquire);
+		}
+
+	private:
+		T *buffer; /**< the ring buffer */
+		unsigned long mask; /**< capacity - 1 */
+		std::atomic<unsigned long> head; /**< position of the next element to pop, written by consumer */
+		char pad[64]; /**< keep head and tail in different cache lines */
+		std::atomic<unsigned long> tail; /**< position of the next element to push, written by producer */
+
+		SpscQueue(const SpscQueue &); /**< not copyable */
+		SpscQueue &operator=(const SpscQueue &); /**< not copyable */
+};
+
+}    // namespace gamcs
+
+#endif /* SPSCQUEUE_H_ */
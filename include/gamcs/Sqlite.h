@@ -20,6 +20,7 @@
 #include "gamcs/Storage.h"
 
 class sqlite3;
+struct sqlite3_stmt;
 
 namespace gamcs
 {
@@ -49,6 +50,8 @@ class Sqlite: public Storage
 				const struct State_Info_Header *state_information_header);
 		void updateStateInfo(
 				const struct State_Info_Header *state_information_header);
+		void upsertStateInfo(
+				const struct State_Info_Header *state_information_header);
 		DEPRECATED("This function is not completely supported yet and will easily lead to storage inconsistent!\n")
 		void deleteState(Agent::State state);
 
@@ -63,10 +66,22 @@ class Sqlite: public Storage
 		std::string db_name; /**< database name */
 		std::string db_t_stateinfo; /**< the table to store state information */
 		std::string db_t_meminfo; /**< the table to store memory information */
-		mutable gamcs_uint current_index; /** index used by iterator */
+		mutable sqlite3_stmt *iter_stmt; /**< the cursor used by iterator, kept open until the storage is closed */
+		mutable bool iter_row; /**< whether the cursor is on a row */
+		mutable bool row_cached; /**< whether the row under the cursor is up to date, so getStateInfo() can read it directly */
+		sqlite3_stmt *get_stmt; /**< prepared statement of getStateInfo() */
+		sqlite3_stmt *has_stmt; /**< prepared statement of hasState() */
+		sqlite3_stmt *add_stmt; /**< prepared statement of addStateInfo(), only in writing mode */
+		sqlite3_stmt *update_stmt; /**< prepared statement of updateStateInfo(), only in writing mode */
+		sqlite3_stmt *delete_stmt; /**< prepared statement of deleteState(), only in writing mode */
+		sqlite3_stmt *upsert_stmt; /**< prepared statement of upsertStateInfo(), only in writing mode */
 		Flag o_flag; /**< the open flag */
 
-		Agent::State stateByIndex(unsigned long index) const;
+		Agent::State stepCursor() const;
+		void closeCursor() const;
+		sqlite3_stmt *prepare(const char *format) const;
+		void prepareStatements();
+		void finalizeStatements();
 };
 
 } /* namespace gamcs */
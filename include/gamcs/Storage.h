@@ -16,6 +16,7 @@
 
 #ifndef STORAGE_H_
 #define STORAGE_H_
+#include <stdlib.h>
 #include <string>
 #include "gamcs/Agent.h"
 
@@ -72,6 +73,17 @@ class Storage
 		 */
 		virtual struct State_Info_Header *getStateInfo(
 				Agent::State state) const = 0; /**< get the information of a specified state value */
+		/**
+		 * @brief Release a state information got by getStateInfo().
+		 *
+		 * By default the information is allocated by malloc(), storages which return it in place should override it.
+		 * @param [in] state_information_header the state information
+		 */
+		virtual void releaseStateInfo(
+				struct State_Info_Header *state_information_header) const
+		{
+			free(state_information_header);
+		}
 		/**
 		 * @brief Add a state to storage from the given information.
 		 *
@@ -92,6 +104,20 @@ class Storage
 		 * @param [in] state the state to be deleted
 		 */
 		virtual void deleteState(Agent::State state) = 0; /**< delete a state from storage */
+		/**
+		 * @brief Add a state to storage, or update it if it exists already.
+		 *
+		 * By default it checks the existence first, storages which can do both in a single write should override it.
+		 * @param [in] state_information_header the state information
+		 */
+		virtual void upsertStateInfo(
+				const struct State_Info_Header *state_information_header)
+		{
+			if (hasState(state_information_header->st))
+				updateStateInfo(state_information_header);
+			else
+				addStateInfo(state_information_header);
+		}
 
 		/**
 		 * @brief Get the memory information from storage.
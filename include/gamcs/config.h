@@ -0,0 +1,36 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Mar 5, 2014
+//
+// -----------------------------------------------------------------------------
+
+/**
+* @mainpage notitle
+* @section GAMCS Documentation
+* This documentation explains the C++ APIs of GAMCS library. For more detailed 
+* explanations abount GAM and GAMCS concepts, please refer to the wiki <a href="http://gamcs.andy87.com">here</a>. 
+*
+*/
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#define INT_BITS 64
+#define VERSION 1.3.7
+
+namespace gamcs
+{
+    const char version[16] = "1.3.7";		/**< the version string */
+}   // namespace gamcs
+
+#endif
@@ -30,7 +30,8 @@ const float Agent::INVALID_PAYOFF = FLT_MAX; /**< use the maximum value to repre
  * @param [in] ac the accuracy
  */
 Agent::Agent(int i, float dr, float ac) :
-		id(i), discount_rate(dr), accuracy(ac), learning_mode(ONLINE)
+		id(i), discount_rate(dr), accuracy(ac), learning_mode(ONLINE), batch_size(
+				1), batch_count(0)
 {
 	// check validity
 	if (discount_rate >= 1.0 || discount_rate < 0)    // [0, 1)
@@ -98,6 +99,57 @@ void Agent::update(float oripayoff)
 {
 	updateMemory(oripayoff);    // update memory
 	TSGIOM::update();    // as a TSGIOM, invoke the basic update function
+
+	++batch_count;
+	if (batch_size != 0 && batch_count >= batch_size)    // the batch is full
+		flush();
+	return;
+}
+
+/**
+ * @brief Set the number of updates in a batch.
+ *
+ * Transitions of a batch are recorded as they happen, but their payoff changes are propagated
+ * all together when the batch is flushed, either automatically when the batch is full or by calling flush().
+ * Note that decisions made in the middle of a batch are based on payoffs at the last flush.
+ * @param [in] bs number of updates in a batch, 1 means flushing at every update, 0 means flushing only when flush() is called
+ * @see flush()
+ */
+void Agent::setBatchSize(unsigned long bs)
+{
+	batch_size = bs;
+	if (batch_size != 0 && batch_count >= batch_size)    // the new batch size is reached
+		flush();
+}
+
+/**
+ * @brief Get the number of updates in a batch.
+ *
+ * @return number of updates in a batch
+ */
+unsigned long Agent::getBatchSize() const
+{
+	return batch_size;
+}
+
+/**
+ * @brief Propagate the payoff changes of all updates in current batch.
+ *
+ * @see flushMemory()
+ */
+void Agent::flush()
+{
+	batch_count = 0;
+	flushMemory();
+}
+
+/**
+ * @brief Propagate the payoff changes deferred by updateMemory().
+ *
+ * Agents which propagate changes immediately in updateMemory() have nothing to do here, which is the default.
+ */
+void Agent::flushMemory()
+{
 	return;
 }
 
@@ -0,0 +1,85 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 20, 2014
+//
+// -----------------------------------------------------------------------------
+
+#include "gamcs/AgentSession.h"
+#include "gamcs/CSOSAgent.h"
+#include "gamcs/ShardedAgent.h"
+
+namespace gamcs
+{
+
+/**
+ * @brief The default constructor.
+ *
+ * @param [in] sa the shared agent
+ * @param [in] i the session id
+ */
+AgentSession::AgentSession(CSOSAgent *sa, int i) :
+		Agent(i), shared(sa), sharded(NULL)
+{
+	if (shared == NULL)
+		ERROR("AgentSession - the shared agent must not be NULL!\n");
+}
+
+/**
+ * @brief Create a session on a sharded agent.
+ *
+ * @param [in] sa the shared sharded agent
+ * @param [in] i the session id
+ */
+AgentSession::AgentSession(ShardedAgent *sa, int i) :
+		Agent(i), shared(NULL), sharded(sa)
+{
+	if (sharded == NULL)
+		ERROR("AgentSession - the shared agent must not be NULL!\n");
+}
+
+/**
+ * @brief The default destructor.
+ */
+AgentSession::~AgentSession()
+{
+}
+
+/**
+ * @brief The Maximum Payoff Rule, decided by the shared memory.
+ *
+ * @param [in] st the state
+ * @param [in] acts the action space of the state
+ * @return the best actions
+ */
+OSpace AgentSession::maxPayoffRule(State st, OSpace &acts) const
+{
+	if (sharded != NULL)
+		return sharded->sharedBestActions(st, acts);
+
+	return shared->sharedBestActions(st, acts);
+}
+
+/**
+ * @brief Learn the transition of this session into the shared memory.
+ *
+ * @param [in] oripayoff original payoff of current state
+ */
+void AgentSession::updateMemory(float oripayoff)
+{
+	if (sharded != NULL)
+		return sharded->sharedLearn(pre_in, pre_out, cur_in, oripayoff);
+
+	shared->sharedLearn(pre_in, pre_out, cur_in, oripayoff);
+}
+
+}    // namespace gamcs
@@ -0,0 +1,328 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 26, 2014
+//
+// -----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include "gamcs/AvatarRunner.h"
+#include "gamcs/Avatar.h"
+#include "gamcs/debug.h"
+
+namespace gamcs
+{
+
+/**
+ * @brief Get the seconds passed since a time point.
+ *
+ * @param [in] start the time point
+ * @return the seconds
+ */
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * @brief The default constructor.
+ *
+ * @param [in] tn number of worker threads, 0 to use all cores
+ */
+AvatarRunner::AvatarRunner(unsigned int tn) :
+		thread_num(tn), remaining(0), wakeups(0), elapsed(0)
+{
+	if (thread_num == 0)
+		thread_num = std::thread::hardware_concurrency();
+	if (thread_num == 0)    // unknown
+		thread_num = 1;
+
+	for (unsigned int i = 0; i < thread_num; i++)
+		queues.push_back(new ar_WorkQueue);
+}
+
+/**
+ * @brief The default destructor.
+ *
+ * Avatars are not deleted.
+ */
+AvatarRunner::~AvatarRunner()
+{
+	for (unsigned int i = 0; i < thread_num; i++)
+		delete queues[i];
+}
+
+/**
+ * @brief Add an avatar to be run.
+ *
+ * @param [in] avatar the avatar, which has been connected to an agent
+ * @param [in] steps the step budget, 0 to run until a dead end is reached
+ */
+void AvatarRunner::addAvatar(Avatar *avatar, unsigned long steps)
+{
+	if (avatar == NULL)
+	{
+		WARNNING("AvatarRunner: add a NULL avatar, ignored!\n");
+		return;
+	}
+
+	struct ar_Task task;
+	task.avatar = avatar;
+	task.budget = steps;
+	task.steps = 0;
+	task.seconds = 0;
+	task.dead_end = false;
+	tasks.push_back(task);
+}
+
+/**
+ * @brief Get the number of avatars.
+ *
+ * @return the number
+ */
+unsigned long AvatarRunner::avatarNum() const
+{
+	return tasks.size();
+}
+
+/**
+ * @brief Run all avatars until they are done, the calling thread is blocked.
+ *
+ * Avatars continue from where they stopped in the last run, those which are done won't run again.
+ */
+void AvatarRunner::run()
+{
+	// deal avatars to workers round robin
+	remaining = 0;
+	for (unsigned long i = 0; i < tasks.size(); i++)
+	{
+		if (tasks[i].dead_end
+				|| (tasks[i].budget != 0 && tasks[i].steps >= tasks[i].budget))
+			continue;
+		queues[remaining % thread_num]->tasks.push_back(i);
+		remaining++;
+	}
+
+	std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (unsigned int w = 1; w < thread_num; w++)
+		workers.push_back(std::thread(&AvatarRunner::workerLoop, this, w));
+	workerLoop(0);    // the calling thread is a worker too
+	for (unsigned int w = 0; w < workers.size(); w++)
+		workers[w].join();
+	elapsed = secondsSince(start);
+}
+
+/**
+ * @brief Main loop of a worker thread.
+ *
+ * @param [in] worker index of the worker
+ */
+void AvatarRunner::workerLoop(unsigned int worker)
+{
+	ar_WorkQueue *queue = queues[worker];
+	while (remaining.load() != 0)
+	{
+		unsigned long ti;
+		unsigned long seen = wakeups.load();
+		if (!takeTask(worker, &ti))    // avatars are all running in other threads, wait for one to come back
+		{
+			std::unique_lock<std::mutex> lock(idle_mutex);
+			while (wakeups.load() == seen && remaining.load() != 0)
+				idle_cv.wait(lock);
+			continue;
+		}
+
+		if (runSlice(&tasks[ti]))    // not done, put it back
+		{
+			{
+				std::lock_guard<std::mutex> lock(queue->mutex);
+				queue->tasks.push_back(ti);
+			}
+			wakeIdle(false);
+		}
+		else if (--remaining == 0)    // the last one, let all idle workers quit
+		{
+			wakeIdle(true);
+		}
+	}
+}
+
+/**
+ * @brief Wake up workers waiting for an avatar to come back.
+ *
+ * Waiters read wakeups before they look into the queues, so a change made after an avatar is put back won't be missed.
+ * @param [in] all wake up all of them, or just one
+ */
+void AvatarRunner::wakeIdle(bool all)
+{
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		wakeups++;
+	}
+	if (all)
+		idle_cv.notify_all();
+	else
+		idle_cv.notify_one();
+}
+
+/**
+ * @brief Take a task from the worker's own queue, or steal one from others.
+ *
+ * @param [in] worker index of the worker
+ * @param [out] ti index of the task taken
+ * @return true if a task is taken, false if all queues are empty
+ */
+bool AvatarRunner::takeTask(unsigned int worker, unsigned long *ti)
+{
+	ar_WorkQueue *queue = queues[worker];
+	{
+		std::lock_guard<std::mutex> lock(queue->mutex);
+		if (!queue->tasks.empty())    // the most recently run one, which is still in cache
+		{
+			*ti = queue->tasks.back();
+			queue->tasks.pop_back();
+			return true;
+		}
+	}
+
+	for (unsigned int i = 1; i < thread_num; i++)
+	{
+		ar_WorkQueue *victim = queues[(worker + i) % thread_num];
+		std::lock_guard<std::mutex> lock(victim->mutex);
+		if (!victim->tasks.empty())    // steal the least recently run one
+		{
+			*ti = victim->tasks.front();
+			victim->tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Step an avatar for a slice.
+ *
+ * @param [in] task the task of the avatar
+ * @return true if the avatar should run further, false if it's done
+ */
+bool AvatarRunner::runSlice(struct ar_Task *task)
+{
+	std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+	for (int i = 0; i < SLICE_STEPS; i++)
+	{
+		if (task->budget != 0 && task->steps >= task->budget)
+			break;
+
+		if (task->avatar->step() == -1)    // reach a dead end
+		{
+			task->dead_end = true;
+			break;
+		}
+		task->steps++;
+	}
+	task->seconds += secondsSince(start);
+
+	return !(task->dead_end
+			|| (task->budget != 0 && task->steps >= task->budget));
+}
+
+/**
+ * @brief Print the aggregate and per-avatar throughput.
+ */
+void AvatarRunner::report() const
+{
+	printf("Avatars: %lu, threads: %u, steps: %lu, time: %.3f secs, %.0f steps/sec\n",
+			avatarNum(), thread_num, totalSteps(), elapsed,
+			elapsed > 0 ? totalSteps() / elapsed : 0.0);
+	for (unsigned long i = 0; i < tasks.size(); i++)
+	{
+		const struct ar_Task &task = tasks[i];
+		printf("avatar %4lu: %10lu steps, %8.3f secs, %10.0f steps/sec%s\n", i,
+				task.steps, task.seconds,
+				task.seconds > 0 ? task.steps / task.seconds : 0.0,
+				task.dead_end ? ", dead end" : "");
+	}
+}
+
+/**
+ * @brief Get the number of worker threads.
+ *
+ * @return the number
+ */
+unsigned int AvatarRunner::threadNum() const
+{
+	return thread_num;
+}
+
+/**
+ * @brief Get the total steps of all avatars.
+ *
+ * @return the steps
+ */
+unsigned long AvatarRunner::totalSteps() const
+{
+	unsigned long steps = 0;
+	for (unsigned long i = 0; i < tasks.size(); i++)
+		steps += tasks[i].steps;
+	return steps;
+}
+
+/**
+ * @brief Get the wall time of the last run.
+ *
+ * @return the time in seconds
+ */
+double AvatarRunner::elapsedTime() const
+{
+	return elapsed;
+}
+
+/**
+ * @brief Get the steps an avatar has run.
+ *
+ * @param [in] index index of the avatar, in the order of adding
+ * @return the steps
+ */
+unsigned long AvatarRunner::avatarSteps(unsigned long index) const
+{
+	return tasks[index].steps;
+}
+
+/**
+ * @brief Get the time spent in stepping an avatar.
+ *
+ * @param [in] index index of the avatar, in the order of adding
+ * @return the time in seconds
+ */
+double AvatarRunner::avatarTime(unsigned long index) const
+{
+	return tasks[index].seconds;
+}
+
+/**
+ * @brief Check if an avatar has reached a dead end.
+ *
+ * @param [in] index index of the avatar, in the order of adding
+ * @return true if it has, false otherwise
+ */
+bool AvatarRunner::reachedDeadEnd(unsigned long index) const
+{
+	return tasks[index].dead_end;
+}
+
+}    // namespace gamcs
@@ -132,7 +132,7 @@ void CDotViewer::view(const char *file)
 		if (stif != NULL)
 		{
 			cleanDotStateInfo(stif, output);
-			free(stif);
+			storage->releaseStateInfo(stif);
 			st = storage->nextState();
 		}
 		else
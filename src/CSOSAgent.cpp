@@ -14,6 +14,11 @@
 #include <float.h>
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include "gamcs/CSOSAgent.h"
 #include "gamcs/Storage.h"
 #include "gamcs/StateInfoParser.h"
@@ -32,11 +37,18 @@ namespace gamcs
  */
 CSOSAgent::CSOSAgent(int i, float dr, float ac) :
 		OSAgent(i, dr, ac), state_num(0), lk_num(0), head(NULL), cur_mst(NULL), current_st_index(
-				NULL)
+				NULL), queue_front(0), update_epoch(0), updated_state_num(0), mirror_num(0), change_log(
+				NULL), propagation(
+				BREADTH_FIRST), state_budget(0), time_budget(0), transitions(NULL), learner(
+				NULL), learner_stopping(false), learner_waiting(false), defer_commit(false), compiled(NULL), compiled_stale(false)
 {
 	states_map.clear();
 	update_queue.clear();
-	visited_states.clear();
+	priority_queue.clear();
+	queue_positions.clear();
+	pending_states.clear();
+	dirty_states.clear();
+	deleted_states.clear();
 }
 
 /**
@@ -44,6 +56,8 @@ CSOSAgent::CSOSAgent(int i, float dr, float ac) :
  */
 CSOSAgent::~CSOSAgent()
 {
+	stopLearner();
+	unfreezeMemory();
 	freeMemory();    // free computer memory
 }
 
@@ -67,7 +81,7 @@ void CSOSAgent::loadState(Storage *storage, Agent::State st)
 	else
 		updateStateInfo(sthd);
 
-	free(sthd);
+	storage->releaseStateInfo(sthd);
 	return;
 }
 
@@ -86,6 +100,7 @@ void CSOSAgent::loadMemoryFromStorage(Storage *storage,
 	int re = storage->open(Storage::O_READ);    // otherwise, load memory from database
 	if (re == 0)    // successfully opened
 	{
+		bool empty = (head == NULL && deleted_states.empty());    // whether memory will be the same as storage after loading
 		char label[10] = "Loading: ";
 		printf("Loading Memory from Storage... \n");
 		fflush (stdout);
@@ -104,6 +119,8 @@ void CSOSAgent::loadMemoryFromStorage(Storage *storage,
 			free(memif);    // free it, the memory struct are not a substaintial struct for running, it's just used to store meta-memory information
 		}
 
+		states_map.reserve(state_num + saved_state_num);    // avoid rehashing while loading
+
 		/* load states information */
 		Agent::State st = storage->firstState();
 		unsigned long index = 0;
@@ -133,6 +150,12 @@ void CSOSAgent::loadMemoryFromStorage(Storage *storage,
 					"LoadMemory(): Number of links not consistent,which by stored meminfo says to be %ld, but in stateinfo is %ld, the storage may be conrupted!\n",
 					saved_lk_num, lk_num);
 		}
+
+		if (empty)    // nothing to be dumped until memory is changed
+		{
+			clearDirty();
+			synced_storage = storage->getMemoryName();
+		}
 	}
 
 	storage->close();
@@ -142,6 +165,7 @@ void CSOSAgent::loadMemoryFromStorage(Storage *storage,
 /**
  * @brief Dump agent memory to a storage, including states information and memory-level statistics.
  *
+ * In batch mode, call flush() first to have payoffs of current batch dumped.
  * @param [in] storage the storage where the memory is dumped to
  * @param [in] the callback function to show a dumping progress
  */
@@ -176,34 +200,118 @@ void CSOSAgent::dumpMemoryToStorage(Storage *storage,
 		// walk through all state structs
 		for (mst = head; mst != NULL; mst = nmst)
 		{
-			if (storage->hasState(mst->st))
-			{
-				dbgmoreprt("SaveMemory()", "Update state: %" ST_FMT ", Payoff: %.3f\n", mst->st, mst->payoff);
-				stif = getStateInfo(mst->st);
-				assert(stif != NULL);
-				storage->updateStateInfo(stif);
-				free(stif);    // free
-			}
-			else    // new state
-			{
-				dbgmoreprt("SaveMemory()", "Add state: %" ST_FMT ", Payoff: %.3f\n", mst->st, mst->payoff);
-				stif = getStateInfo(mst->st);
-				assert(stif != NULL);
-				storage->addStateInfo(stif);
-				free(stif);    // free
-			}
+			dbgmoreprt("SaveMemory()", "Save state: %" ST_FMT ", Payoff: %.3f\n", mst->st, mst->payoff);
+			stif = getStateInfo(mst->st);
+			assert(stif != NULL);
+			storage->upsertStateInfo(stif);    // add or update in one write
+			free(stif);    // free
 
 			index++;
 			if (progbar)
 				progbar(index, state_num, label);
 			nmst = mst->next;
 		}
+
+		// states deleted from memory may still be in storage
+		std::unordered_set<State>::iterator it;
+		for (it = deleted_states.begin(); it != deleted_states.end(); ++it)
+			if (searchState(*it) == NULL)
+				storage->deleteState(*it);
+
+		clearDirty();
+		synced_storage = storage->getMemoryName();
+	}
+
+	storage->close();
+	return;
+}
+
+/**
+ * @brief Dump only the changes of agent memory since it was last dumped to or loaded from the same storage.
+ *
+ * States changed since then are written, states deleted since then are deleted from storage, and memory-level statistics are updated.
+ * If the memory has not been dumped to or loaded from this storage yet, the whole memory is dumped instead.
+ * In batch mode, call flush() first to have payoffs of current batch dumped.
+ * @param [in] storage the storage where the memory is dumped to
+ * @param [in] the callback function to show a dumping progress
+ * @see dumpMemoryToStorage()
+ */
+void CSOSAgent::dumpChangesToStorage(Storage *storage,
+		progbar_callback progbar) const
+{
+	if (storage == NULL)    // no database specified, no need to save
+		return;
+
+	if (synced_storage.empty() || storage->getMemoryName() != synced_storage)    // storage doesn't have the unchanged states
+		return dumpMemoryToStorage(storage, progbar);
+
+	char label[10] = "Saving: ";
+	printf("Saving Memory Changes to Storage... \n");
+	int re = storage->open(Storage::O_WRITE);    // open for writing
+	if (re == 0)    // successfully connected
+	{
+		/* save memory information */
+		struct Memory_Info *memif = (struct Memory_Info *) malloc(
+				sizeof(struct Memory_Info));
+		memif->discount_rate = discount_rate;
+		memif->accuracy = accuracy;
+		memif->lk_num = lk_num;
+		memif->state_num = state_num;
+		memif->last_st = pre_in;
+		memif->last_act = pre_out;
+
+		storage->addMemoryInfo(memif);    // Add to storage
+		free(memif);    // free it
+
+		/* delete first, a state may be deleted and then created again */
+		std::unordered_set<State>::iterator it;
+		for (it = deleted_states.begin(); it != deleted_states.end(); ++it)
+			storage->deleteState(*it);
+
+		/* save changed states */
+		struct State_Info_Header *stif = NULL;
+		unsigned long index = 0, total = dirty_states.size();
+		std::unordered_set<cs_State *>::iterator dit;
+		for (dit = dirty_states.begin(); dit != dirty_states.end(); ++dit)
+		{
+			dbgmoreprt("SaveChanges()", "Save state: %" ST_FMT ", Payoff: %.3f\n", (*dit)->st, (*dit)->payoff);
+			stif = getStateInfo((*dit)->st);
+			assert(stif != NULL);
+			storage->upsertStateInfo(stif);    // add or update in one write
+			free(stif);    // free
+
+			index++;
+			if (progbar)
+				progbar(index, total, label);
+		}
+
+		clearDirty();
 	}
 
 	storage->close();
 	return;
 }
 
+/**
+ * @brief Get the number of states changed since the memory was last dumped.
+ *
+ * @return the number
+ */
+unsigned long CSOSAgent::dirtyStateNum() const
+{
+	return dirty_states.size();
+}
+
+/**
+ * @brief Get the number of states deleted since the memory was last dumped.
+ *
+ * @return the number
+ */
+unsigned long CSOSAgent::deletedStateNum() const
+{
+	return deleted_states.size();
+}
+
 /**
  * @brief Search for a state in memory.
  *
@@ -212,11 +320,7 @@ void CSOSAgent::dumpMemoryToStorage(Storage *storage,
  */
 struct cs_State *CSOSAgent::searchState(Agent::State st) const
 {
-	StatesMap::const_iterator it = states_map.find(st);    // find the state value in hash map
-	if (it != states_map.end())    // found
-		return (struct cs_State *) (it->second);
-	else
-		return NULL;
+	return (struct cs_State *) states_map.find(st);    // find the state value in hash map, NULL if not found
 }
 
 /**
@@ -229,15 +333,22 @@ struct cs_State *CSOSAgent::searchState(Agent::State st) const
  */
 struct cs_State *CSOSAgent::newState(Agent::State st)
 {
-	struct cs_State *mst = (struct cs_State *) malloc(sizeof(struct cs_State));
-	assert(mst != NULL);
+	struct cs_State *mst = state_pool.alloc();
 	// fill in default values
 	mst->st = st;
 	mst->original_payoff = 0.0;    // use 0 as default
 	mst->payoff = 0.0;
+	mst->committed_payoff = 0.0;
 	mst->count = 1;    // it's created when we first encounter it
 	mst->actlist = NULL;
+	mst->act_num = 0;
+	mst->actindex = NULL;
 	mst->blist = NULL;
+	mst->blk_num = 0;
+	mst->blkindex = NULL;
+	mst->visit = 0;    // epochs start from 1
+	mst->remote = false;
+	markDirty(mst);    // a new state has to be dumped
 
 	// Add mst to the front of head
 	mst->prev = NULL;
@@ -246,7 +357,7 @@ struct cs_State *CSOSAgent::newState(Agent::State st)
 		head->prev = mst;
 	head = mst;
 
-	states_map.insert(StatesMap::value_type(mst->st, mst));    // don't forget to update hash map
+	states_map.insert(mst->st, mst);    // don't forget to update hash map
 
 	state_num++;
 	return mst;
@@ -272,6 +383,7 @@ void CSOSAgent::freeState(struct cs_State *mst)
 		nac = ac->next;
 		freeAct(ac);
 	}
+	freeActIndex(mst);
 
 	/* free blist */
 	struct cs_BackwardLink *bas, *nbas;
@@ -280,8 +392,9 @@ void CSOSAgent::freeState(struct cs_State *mst)
 		nbas = bas->next;
 		freeBlk(bas);
 	}
+	freeBlkIndex(mst);
 
-	return free(mst);
+	return state_pool.release(mst);
 }
 
 /**
@@ -297,8 +410,7 @@ void CSOSAgent::freeState(struct cs_State *mst)
 struct cs_EnvAction *CSOSAgent::newEat(EnvAction eat, struct cs_State *nst,
 		struct cs_Action *mac)
 {
-	struct cs_EnvAction *meat = (struct cs_EnvAction *) malloc(
-			sizeof(struct cs_EnvAction));
+	struct cs_EnvAction *meat = eat_pool.alloc();
 	meat->eat = eat;
 	meat->count = 1;
 	meat->nstate = nst;
@@ -306,6 +418,7 @@ struct cs_EnvAction *CSOSAgent::newEat(EnvAction eat, struct cs_State *nst,
 	// add to ealist
 	meat->next = mac->ealist;
 	mac->ealist = meat;
+	mac->count += meat->count;    // keep the total count up to date
 
 	lk_num++;    // increase link number
 	return meat;
@@ -319,7 +432,7 @@ struct cs_EnvAction *CSOSAgent::newEat(EnvAction eat, struct cs_State *nst,
  */
 void CSOSAgent::freeEat(struct cs_EnvAction *meat)
 {
-	return free(meat);
+	return eat_pool.release(meat);
 }
 
 /**
@@ -339,11 +452,26 @@ struct cs_BackwardLink *CSOSAgent::newBlk(struct cs_State *pmst,
 
 	if (bas == NULL)    // not found, create a new one and Add to blist
 	{
-		bas = (struct cs_BackwardLink *) malloc(sizeof(struct cs_BackwardLink));
+		bas = blk_pool.alloc();
 		bas->pstate = pmst;    // previous state is mst
 		// Add to blist
+		bas->prev = NULL;
 		bas->next = mst->blist;
+		if (mst->blist != NULL)
+			mst->blist->prev = bas;
 		mst->blist = bas;
+		mst->blk_num++;
+
+		// update the index, build it if the state has too many backward links to be searched linearly
+		if (mst->blkindex != NULL)
+			mst->blkindex->insert(pmst, bas);
+		else if (mst->blk_num > BLK_INDEX_THRESHOLD)
+		{
+			mst->blkindex = new AdaptiveIndex<cs_State *, cs_BackwardLink *>();
+			for (struct cs_BackwardLink *blk = mst->blist; blk != NULL; blk =
+					blk->next)
+				mst->blkindex->insert(blk->pstate, blk);
+		}
 	}
 
 	return bas;
@@ -355,7 +483,7 @@ struct cs_BackwardLink *CSOSAgent::newBlk(struct cs_State *pmst,
  */
 void CSOSAgent::freeBlk(struct cs_BackwardLink *bas)
 {
-	return free(bas);
+	return blk_pool.release(bas);
 }
 
 /**
@@ -368,6 +496,9 @@ void CSOSAgent::freeBlk(struct cs_BackwardLink *bas)
 struct cs_Action* CSOSAgent::searchAct(Agent::Action act,
 		const struct cs_State *mst) const
 {
+	if (mst->actindex != NULL)    // use the index if available
+		return mst->actindex->find(act);
+
 	struct cs_Action *ac, *nac;
 	// walk through action list
 	for (ac = mst->actlist; ac != NULL; ac = nac)
@@ -414,6 +545,9 @@ struct cs_EnvAction *CSOSAgent::searchEat(EnvAction eat, struct cs_State *nmst,
 struct cs_BackwardLink *CSOSAgent::searchBlk(struct cs_State *pmst,
 		const struct cs_State *mst) const
 {
+	if (mst->blkindex != NULL)    // use the index if available
+		return mst->blkindex->find(pmst);
+
 	struct cs_BackwardLink *bas, *nbas;
 	for (bas = mst->blist; bas != NULL; bas = nbas)
 	{
@@ -443,6 +577,10 @@ void CSOSAgent::deleteAct(Agent::Action act, struct cs_State *mst)
 	{
 		if (tmp->act == act)    // found
 		{
+			mst->act_num--;
+			if (mst->actindex != NULL)
+				mst->actindex->erase(act);
+
 			if (tmp == mst->actlist)    // it's head
 			{
 				mst->actlist = tmp->next;
@@ -495,6 +633,7 @@ void CSOSAgent::deleteEat(Agent::EnvAction eat, const struct cs_State *nst,
 	{
 		if (tmp->eat == eat && tmp->nstate == nst)    // found
 		{
+			mac->count -= tmp->count;    // remove its count from the total
 			if (tmp == mac->ealist)    // head
 			{
 				mac->ealist = tmp->next;
@@ -530,32 +669,23 @@ void CSOSAgent::deleteEat(Agent::EnvAction eat, const struct cs_State *nst,
  */
 void CSOSAgent::deleteBlk(struct cs_State *pmst, struct cs_State *mst)
 {
-	struct cs_BackwardLink *tmp, *prev = NULL;
-	tmp = mst->blist;
-	while (tmp != NULL)
-	{
-		if (tmp->pstate == pmst)    // found
-		{
-			if (tmp == mst->blist)    // head
-			{
-				mst->blist = tmp->next;
-				freeBlk(tmp);
-				return;
-			}
-			else
-			{
-				prev->next = tmp->next;
-				freeBlk(tmp);
-				return;
-			}
-		}
-		else
-		{
-			prev = tmp;
-			tmp = tmp->next;
-		}
-	}
-	return;
+	struct cs_BackwardLink *bas = searchBlk(pmst, mst);
+	if (bas == NULL)    // not found
+		return;
+
+	// remove it from the double link
+	if (bas->prev != NULL)
+		bas->prev->next = bas->next;
+	else
+		mst->blist = bas->next;    // it's head
+	if (bas->next != NULL)
+		bas->next->prev = bas->prev;
+
+	mst->blk_num--;
+	if (mst->blkindex != NULL)
+		mst->blkindex->erase(pmst);
+
+	return freeBlk(bas);
 }
 
 /**
@@ -569,15 +699,27 @@ void CSOSAgent::deleteBlk(struct cs_State *pmst, struct cs_State *mst)
  */
 struct cs_Action *CSOSAgent::newAct(Agent::Action act, struct cs_State *mst)
 {
-	struct cs_Action *mac = (struct cs_Action *) malloc(
-			sizeof(struct cs_Action));
+	struct cs_Action *mac = act_pool.alloc();
 
 	mac->act = act;
+	mac->count = 0;
 	mac->ealist = NULL;
 
 	// add to actlist
 	mac->next = mst->actlist;
 	mst->actlist = mac;
+	mst->act_num++;
+
+	// update the index, build it if the state has too many actions to be searched linearly
+	if (mst->actindex != NULL)
+		mst->actindex->insert(act, mac);
+	else if (mst->act_num > ACT_INDEX_THRESHOLD)
+	{
+		mst->actindex = new AdaptiveIndex<Agent::Action, cs_Action *>();
+		for (struct cs_Action *ac = mst->actlist; ac != NULL; ac = ac->next)
+			mst->actindex->insert(ac->act, ac);
+	}
+
 	return mac;
 }
 
@@ -598,7 +740,7 @@ void CSOSAgent::freeAct(struct cs_Action *ac)
 		freeEat(meat);
 	}
 
-	return free(ac);
+	return act_pool.release(ac);
 }
 
 /**
@@ -620,6 +762,7 @@ void CSOSAgent::linkStates(struct cs_State *mst, EnvAction eat,
 
 	struct cs_Action *mac;
 	struct cs_EnvAction *meat;
+	markDirty(mst);    // either a count or a link of mst will be changed
 
 	/* check if the link already exists, if so simply update the count of environment action */
 	mac = searchAct(act, mst);
@@ -630,6 +773,7 @@ void CSOSAgent::linkStates(struct cs_State *mst, EnvAction eat,
 		{
 			dbgmoreprt("LinkStates():", "link already exists, increase count only\n");
 			meat->count++;    // increase count
+			mac->count++;
 			return;    // done, return
 		}
 		else    // act exists, but eat not exist, meat == NULL
@@ -661,15 +805,7 @@ float CSOSAgent::prob(const struct cs_EnvAction *ea,
 		const struct cs_Action *mac) const
 {
 	unsigned long eacount = ea->count;
-	// calculate the sum of env action counts
-	unsigned long sum_eacount = 0;
-	struct cs_EnvAction *pea, *pnea;
-	for (pea = mac->ealist; pea != NULL; pea = pnea)
-	{
-		sum_eacount += pea->count;
-
-		pnea = pea->next;
-	}
+	unsigned long sum_eacount = mac->count;    // the sum of env action counts is maintained along with ealist
 
 	// state count donesn't equal to sum of eacount due to the set operation (actually state count will become smaller than sum eacount gradually)
 	dbgmoreprt("Prob", "------- action: %" ACT_FMT "\n", mac->act);dbgmoreprt("Prob", "sum: %ld\n", sum_eacount);
@@ -697,6 +833,9 @@ float CSOSAgent::prob(const struct cs_EnvAction *ea,
  */
 float CSOSAgent::calStatePayoff(const struct cs_State *mst) const
 {
+	if (mst->remote)    // the owner shard takes care of it
+		return mst->payoff;
+
 	dbgmoreprt("\nCalStatePayoff()", "----------------- state: %" ST_FMT ", count: %ld\n", mst->st, mst->count);
 
 	float u0 = mst->original_payoff;
@@ -732,44 +871,70 @@ float CSOSAgent::calStatePayoff(const struct cs_State *mst) const
  */
 void CSOSAgent::updateStatePayoff(cs_State *mst)
 {
-	// clear update_queue and visited_states first every time
-	update_queue.clear();
-	visited_states.clear();
+	beginPropagation();
+	seedPropagation(mst);
+	propagate();
+}
+
+/**
+ * @brief Start a new propagation, states queued by previous propagations can be queued again.
+ */
+void CSOSAgent::beginPropagation()
+{
+	update_queue.clear();    // the capacity is kept for reusing
+	queue_front = 0;
+	update_epoch++;
+}
 
-	update_queue.push_back(mst);    // add the starting state
+/**
+ * @brief Queue a state to be updated in the current propagation.
+ *
+ * @param [in] mst the state
+ */
+void CSOSAgent::seedPropagation(cs_State *mst)
+{
+	if (mst->visit == update_epoch)    // already updated in this propagation
+		return;
+
+	update_queue.push_back(mst);
+}
+
+/**
+ * @brief Update the queued states and their up-streaming states breadth-first, until payoffs no longer change.
+ *
+ * A state is not queued again once it has been updated in the propagation.
+ */
+void CSOSAgent::propagate()
+{
+	compiled_stale = true;    // payoffs will be changed
 
 	cs_State *cmst = NULL;
 	register float payoff = 0.0;
-	struct cs_BackwardLink *bas, *nbas;
+	struct cs_BackwardLink *bas;
 
-	while (!update_queue.empty())
+	while (queue_front < update_queue.size())
 	{
-		cmst = update_queue.front();    // get the state at front
+		cmst = update_queue[queue_front++];    // get the state at front
+		cmst->visit = update_epoch;    // mark visited
 		payoff = calStatePayoff(cmst);
+		updated_state_num++;
 
 		if (cmst->payoff != payoff)    // the backtrace will stop at where the payoff won't change
 		{
 			cmst->payoff = payoff;
-			dbgmoreprt("UpdateState()", "State: %" ST_FMT " change to payoff: %.3f\n", cmst->st, payoff);
-
-			// push previous states to queue
-			for (bas = cmst->blist; bas != NULL; bas = nbas)
-			{
-				// visited state will not be pushed
-				if (visited_states.find(bas->pstate) == visited_states.end())    // not found
-				{
-					update_queue.push_back(bas->pstate);
-				}
-				nbas = bas->next;
-			}
+			markDirty(cmst);
+			if (change_log != NULL)
+				change_log->push_back(cmst->st);
+			dbgmoreprt("Propagate()", "State: %" ST_FMT " change to payoff: %.3f\n", cmst->st, payoff);
+
+			// push previous states to queue, visited state will not be pushed
+			for (bas = cmst->blist; bas != NULL; bas = bas->next)
+				seedPropagation(bas->pstate);
 		}
 		else
 		{
-			dbgmoreprt("UpdateState()", "State: %" ST_FMT ", payoff no changes, update stopped here.\n", cmst->st);
+			dbgmoreprt("Propagate()", "State: %" ST_FMT ", payoff no changes, update stopped here.\n", cmst->st);
 		}
-
-		visited_states.insert(cmst);    // save visited state
-		update_queue.pop_front();    // remove the state at front
 	}
 }
 
@@ -796,17 +961,19 @@ float CSOSAgent::calActPayoff(Agent::Action act,
  *
  * $ u(O^j_i) = \sum_{k=1}^m{P(E^k_i|O^j_i) * u(I^{k,j}_i)} $
  * @param [in] mac the address pointer of the action to be calculated
+ * @param [in] committed use the committed payoffs of the following states instead of the current ones
  * @return payoff of the action
  * @see calStatePayoff()
  **/
-float CSOSAgent::_calActPayoff(const cs_Action *mac) const
+float CSOSAgent::_calActPayoff(const cs_Action *mac, bool committed) const
 {
 	register float payoff = 0;
 
 	struct cs_EnvAction *ea, *nea;
 	for (ea = mac->ealist; ea != NULL; ea = nea)
 	{
-		payoff += prob(ea, mac) * ea->nstate->payoff;
+		payoff += prob(ea, mac)
+				* (committed ? ea->nstate->committed_payoff : ea->nstate->payoff);
 
 		nea = ea->next;
 	}
@@ -832,35 +999,134 @@ float CSOSAgent::trimPayoff(float pf) const
 	}
 }
 
+/**
+ * @brief Add a range of outputs in a fragment to an output space.
+ *
+ * @param [in,out] acts the output space
+ * @param [in] frag the fragment
+ * @param [in] from position of the first output in the fragment
+ * @param [in] to position after the last output in the fragment
+ */
+static void addFragmentRange(OSpace &acts, const OFragment &frag,
+		OSpace::ossize_t from, OSpace::ossize_t to)
+{
+	if (from >= to)
+		return;
+
+	GIOM::Output start = frag.start + frag.step * (GIOM::Output) from;
+	if (to - from == 1)
+		acts.add(start);
+	else
+		acts.add(start, frag.start + frag.step * (GIOM::Output) (to - 1),
+				frag.step);
+}
+
+/**
+ * @brief Add the actions of a fragment which have the maximum payoff to the best actions.
+ *
+ * Unseen actions have payoff 0, they are added as sub-ranges of the fragment without being enumerated.
+ * @param [in,out] best_acts the best actions so far
+ * @param [in,out] max_payoff payoff of the best actions so far
+ * @param [in] frag the fragment
+ * @param [in] size number of actions in the fragment
+ * @param [in] known positions and payoffs of the known actions in the fragment, ordered by position
+ */
+static void addFragmentBest(OSpace &best_acts, float &max_payoff,
+		const OFragment &frag, OSpace::ossize_t size,
+		const std::vector<std::pair<OSpace::ossize_t, float> > &known)
+{
+	bool has_unseen = known.size() < size;
+	float frag_max = has_unseen ? 0.0 : -FLT_MAX;
+	std::vector<std::pair<OSpace::ossize_t, float> >::const_iterator it;
+	for (it = known.begin(); it != known.end(); ++it)
+	{
+		if (it->second > frag_max)
+			frag_max = it->second;
+	}
+
+	if (frag_max < max_payoff)    // nothing better here
+		return;
+	if (frag_max > max_payoff)    // find a bigger one, refill the max payoff action list
+	{
+		best_acts.clear();
+		max_payoff = frag_max;
+	}
+
+	if (has_unseen && max_payoff == 0)    // unseen actions are among the best, add the fragment except known actions with other payoffs
+	{
+		OSpace::ossize_t from = 0;
+		for (it = known.begin(); it != known.end(); ++it)
+		{
+			if (it->second == 0)
+				continue;
+			addFragmentRange(best_acts, frag, from, it->first);
+			from = it->first + 1;
+		}
+		addFragmentRange(best_acts, frag, from, size);
+	}
+	else
+	{
+		for (it = known.begin(); it != known.end(); ++it)
+		{
+			if (it->second == max_payoff)
+				best_acts.add(frag.start + frag.step * (GIOM::Output) it->first);
+		}
+	}
+}
+
 /**
  * @brief Find and choose the best actions of a state from the action space.
  *
+ * Only known actions are evaluated, a fragment is enumerated only if it's smaller than the action list of the state.
+ * So the cost depends on the number of known actions, not the size of the action space.
+ * Outputs are the same and in the same order as comparing every action in the space.
  * @param [in] mst the state
  * @param [in] acts the action space of the state
+ * @param [in] committed use the committed payoffs instead of the current ones
  * @return the best actions
  */
-OSpace CSOSAgent::bestActions(const struct cs_State *mst, OSpace &acts) const
+OSpace CSOSAgent::bestActions(const struct cs_State *mst, OSpace &acts,
+		bool committed) const
 {
-	register float max_payoff = -FLT_MAX, payoff = 0;
+	float max_payoff = -FLT_MAX;
 	OSpace best_acts;
+	static thread_local std::vector<std::pair<OSpace::ossize_t, float> > known;    // reused, sessions may decide concurrently
 
-	best_acts.clear();
-	// walk through every action in list
-	register Agent::Action act = acts.first();
-	while (act != INVALID_ACTION)    // until out of bound
+	for (OSpace::ossize_t fi = 0; fi < acts.fragmentNum(); fi++)
 	{
-		payoff = calActPayoff(act, mst);
+		const OFragment &frag = acts.fragment(fi);
+		OSpace::ossize_t size = acts.fragmentSize(fi);
 
-		if (payoff > max_payoff)    // find a bigger one, refill the max payoff action list
+		known.clear();
+		if (size <= mst->act_num)    // a small fragment, look up each action in it
+		{
+			for (OSpace::ossize_t p = 0; p < size; p++)
+			{
+				cs_Action *mac = searchAct(
+						frag.start + frag.step * (GIOM::Output) p, mst);
+				if (mac != NULL)
+					known.push_back(
+							std::make_pair(p, _calActPayoff(mac, committed)));
+			}
+		}
+		else    // a large fragment, find known actions which are in it
 		{
-			best_acts.clear();
-			best_acts.add(act);
-			max_payoff = payoff;
+			for (cs_Action *mac = mst->actlist; mac != NULL; mac = mac->next)
+			{
+				GIOM::Output dist = mac->act - frag.start;
+				if (dist % frag.step != 0)
+					continue;
+				GIOM::Output p = dist / frag.step;
+				if (p < 0 || (OSpace::ossize_t) p >= size)
+					continue;
+				known.push_back(
+						std::make_pair((OSpace::ossize_t) p,
+								_calActPayoff(mac, committed)));
+			}
+			std::sort(known.begin(), known.end());
 		}
-		else if (payoff == max_payoff)    // find an equal one, Add it to the list
-			best_acts.add(act);
 
-		act = acts.next();
+		addFragmentBest(best_acts, max_payoff, frag, size, known);
 	}
 	return best_acts;
 }
@@ -868,156 +1134,699 @@ OSpace CSOSAgent::bestActions(const struct cs_State *mst, OSpace &acts) const
 /**
  * @brief Update states in memory.
  *
+ * When the learner is running, the transition is only queued for the learner thread.
  * Note: This function should be called AFTER MaxPayoffRule() in every step!
  * @param [in] oripayoff original payoff of current state
  */
 void CSOSAgent::updateMemory(float oripayoff)
 {
 	dbgmoreprt("\nEnter UpdateMemory()", "-------------------------------------------------\n");
+	if (compiled != NULL)    // learning is suspended when memory is frozen
+		return;
+
+	if (learner != NULL)
+	{
+		cs_Transition tr;
+		tr.pst = pre_in;
+		tr.pact = pre_out;
+		tr.st = cur_in;
+		tr.original_payoff = oripayoff;
+		while (!transitions->push(tr))    // the learner falls behind, wait for it
+			std::this_thread::yield();
+		std::atomic_thread_fence(std::memory_order_seq_cst);    // the learner checks the queue after announcing it's waiting
+		if (learner_waiting)
+		{
+			std::lock_guard<std::mutex> lock(learner_mutex);
+			learner_cv.notify_one();
+		}
+		return;
+	}
+
 	// In EXPLORE/TEACH mode, maxPayoffRule() will not run, which leaves cur_mst unset, so we have to set cur_mst here
 	// otherwise, cur_mst will be set by maxPayoffRule().
 	// FIXME: this reduces time to search but is a bit ugly!
 	if (learning_mode == EXPLORE)
 		cur_mst = searchState(cur_in);
 
-	if (pre_in == INVALID_STATE)    // previous state not exist, it's running for the first time
+	cur_mst = learnTransition(pre_in, pre_out, cur_in, cur_mst, oripayoff);
+}
+
+/**
+ * @brief Record a transition in memory, payoffs of affected states are updated when the batch is flushed.
+ *
+ * @param [in] pst the previous state, INVALID_STATE if it's the first transition
+ * @param [in] pact the action performed under the previous state
+ * @param [in] st the current state
+ * @param [in] mst state structure of the current state, NULL if not in memory
+ * @param [in] oripayoff original payoff of the current state
+ * @return state structure of the current state
+ */
+struct cs_State *CSOSAgent::learnTransition(Agent::State pst,
+		Agent::Action pact, Agent::State st, struct cs_State *mst,
+		float oripayoff)
+{
+	if (pst == INVALID_STATE)    // previous state not exist, it's running for the first time
 	{
 		dbgmoreprt("", "Previous state not exists, create current state in memory.\n");
-		//NOTE: cur_mst is already set in MaxPayoffRule() function
-		if (cur_mst == NULL)    // create current state in memory
+		if (mst == NULL)    // create current state in memory
 		{
-			cur_mst = newState(cur_in);
+			mst = newState(st);
 			if (oripayoff != INVALID_PAYOFF)
-				cur_mst->original_payoff = oripayoff;    // set original payoff as given if it's valid, else no changes
+				mst->original_payoff = oripayoff;    // set original payoff as given if it's valid, else no changes
 		}
 		else    // state found, this could happen if others send state information to me before the first time I'm running
 		{
 			dbgmoreprt("", "Previous state not exists, but I recieved some information of this state from others.\n");
 			// update current state
-			cur_mst->count++;    // inc state count
+			mst->count++;    // inc state count
 			if (oripayoff != INVALID_PAYOFF)
-				cur_mst->original_payoff = oripayoff;    // reset original payoff
+				mst->original_payoff = oripayoff;    // reset original payoff
+			markDirty(mst);
 			// no previous state, so no link involved
 		}
 
-		return;
+		return mst;
 	}
 
-	dbgmoreprt("", "Previous state is %ld.\n", pre_in);
+	dbgmoreprt("", "Previous state is %ld.\n", pst);
 	/* previous state exists */
-	struct cs_State *pmst = searchState(pre_in);    // found previous state struct
+	struct cs_State *pmst = searchState(pst);    // found previous state struct
 	if (pmst == NULL)
 		ERROR(
 				"UpdateMemory(): Can not find previous state %" ST_FMT " in memory, which should be existing!\n",
-				pre_in);
+				pst);
 
-	//NOTE: cur_mst is already set in MaxPayoffRule() function
-	if (cur_mst == NULL)    // current state struct not exists in memory, create it in memory, and link it to the previous state
+	if (mst == NULL)    // current state struct not exists in memory, create it in memory, and link it to the previous state
 	{
 		dbgmoreprt("", "current state not exists, create it and build the link\n");
-		cur_mst = newState(cur_in);
+		mst = newState(st);
 		if (oripayoff != INVALID_PAYOFF)
-			cur_mst->original_payoff = oripayoff;
+			mst->original_payoff = oripayoff;
 
 		// build the link
-		EnvAction peat = cur_in - pre_in - pre_out;    // calcuate previous environment action. This formula is important!!!
-		linkStates(pmst, peat, pre_out, cur_mst);    // build the link
+		EnvAction peat = st - pst - pact;    // calcuate previous environment action. This formula is important!!!
+		linkStates(pmst, peat, pact, mst);    // build the link
 	}
 	else    // current state struct already exists, update the count and link it to the previous state (LinkStates will handle it if the link already exists.)
 	{
-		dbgmoreprt("", "current state is %" ST_FMT ", increase count and build the link\n", cur_mst->st);
+		dbgmoreprt("", "current state is %" ST_FMT ", increase count and build the link\n", mst->st);
 		// update current state
-		cur_mst->count++;    // inc state count
+		mst->count++;    // inc state count
 		if (oripayoff != INVALID_PAYOFF)
-			cur_mst->original_payoff = oripayoff;    // reset original payoff
+			mst->original_payoff = oripayoff;    // reset original payoff
+		markDirty(mst);
 
 		// build the link
-		EnvAction peat = cur_in - pre_in - pre_out;
-		linkStates(pmst, peat, pre_out, cur_mst);
+		EnvAction peat = st - pst - pact;
+		linkStates(pmst, peat, pact, mst);
 	}
 
-	// update payoff starting from previous states recursively
+	// payoffs will be updated starting from previous states recursively when the batch is flushed.
 	// DO NOT start from current state, the previous states need to
 	// be updated because of the new created link to current state!
-	struct cs_BackwardLink *blk, *nblk;
-	for (blk = cur_mst->blist; blk != NULL; blk = nblk)
-	{
-		updateStatePayoff(blk->pstate);
-
-		nblk = blk->next;
-	}
+	struct cs_BackwardLink *blk;
+	for (blk = mst->blist; blk != NULL; blk = blk->next)
+		addPending(blk->pstate);
 
-	return;
+	return mst;
 }
 
 /**
- * @brief Free the whole computer memory used by an agent.
+ * @brief Update payoffs starting from all the states collected in current batch.
+ *
+ * It's done by the learner thread itself when the learner is running.
  */
-void CSOSAgent::freeMemory()
+void CSOSAgent::flushMemory()
 {
-	// free all states in turn
-	struct cs_State *mst, *nmst;
-	for (mst = head; mst != NULL; mst = nmst)
-	{
-		nmst = mst->next;
-		freeState(mst);
-	}
+	if (learner != NULL)
+		return;
 
-	states_map.clear();
-	update_queue.clear();
-	visited_states.clear();
+	propagatePending();
 }
 
 /**
- * @brief Delete and free a specified state from memory.
+ * @brief Update payoffs starting from all pending states.
  *
- * @param [in] mst the state to be deleted
+ * Pending states are updated in one propagation, so every affected state is updated once for the whole batch.
  */
-void CSOSAgent::_deleteState(struct cs_State *mst)
+void CSOSAgent::propagatePending()
 {
-	if (mst == NULL)
+	if (pending_states.empty())
+		return;
+
+	compactPending();
+	std::vector<cs_State *>::iterator it;
+	if (propagation == PRIORITIZED)
 	{
+		// the changes are unknown yet, so pending states are queued ahead of all others
+		for (it = pending_states.begin(); it != pending_states.end(); ++it)
+			queueState(*it, FLT_MAX);
+		pending_states.clear();
+
+		sweepQueue();
 		return;
 	}
 
-	// first, remove mst from previous states' forward links
-	struct cs_BackwardLink *blk, *nblk;
-	struct cs_Action *mac, *nmac;
-	struct cs_EnvAction *meat, *nmeat;
-	struct cs_State *pmst, *nmst;
-	for (blk = mst->blist; blk != NULL; blk = nblk)
-	{
-		pmst = blk->pstate;
-		for (mac = pmst->actlist; mac != NULL; mac = nmac)
-		{
-			Agent::EnvAction eat = mst->st - pmst->st - mac->act;    // calculate the possible eat
-			deleteEat(eat, mst, mac);
+	beginPropagation();
+	for (it = pending_states.begin(); it != pending_states.end(); ++it)
+		seedPropagation(*it);
+	pending_states.clear();
 
-			nmac = mac->next;
-		}
+	propagate();
+}
 
-		nblk = blk->next;
-	}
+/**
+ * @brief Add a state to be updated when current batch is flushed.
+ *
+ * A state added again is dropped when the batch is compacted, so the batch never grows beyond twice the states in memory.
+ * @param [in] mst the state
+ */
+void CSOSAgent::addPending(struct cs_State *mst)
+{
+	if (!pending_states.empty() && pending_states.back() == mst)    // just added
+		return;
 
-	// then, remove mst from following states' backward links
-	for (mac = mst->actlist; mac != NULL; mac = nmac)
-	{
-		for (meat = mac->ealist; meat != NULL; meat = nmeat)
-		{
-			nmst = meat->nstate;
-			deleteBlk(mst, nmst);
+	pending_states.push_back(mst);
+	if (pending_states.size() > 2 * state_num)
+		compactPending();
+}
 
-			nmeat = meat->next;
-		}
+/**
+ * @brief Remove a state from current batch.
+ *
+ * @param [in] mst the state
+ */
+void CSOSAgent::removePending(struct cs_State *mst)
+{
+	pending_states.erase(
+			std::remove(pending_states.begin(), pending_states.end(), mst),
+			pending_states.end());
+}
 
-		nmac = mac->next;
+/**
+ * @brief Drop the states which are added to current batch more than once, the first ones are kept in order.
+ */
+void CSOSAgent::compactPending()
+{
+	std::unordered_set<cs_State *> added;
+	added.reserve(pending_states.size());
+	unsigned long k = 0;
+	for (unsigned long i = 0; i < pending_states.size(); i++)
+	{
+		if (added.insert(pending_states[i]).second)
+			pending_states[k++] = pending_states[i];
 	}
+	pending_states.resize(k);
+}
 
-	// update lk_num
-	for (mac = mst->actlist; mac != NULL; mac = nmac)
-	{
-		for (meat = mac->ealist; meat != NULL; meat = nmeat)
-		{
+/**
+ * @brief Mark a state as changed, so it will be written by the next dump of changes.
+ *
+ * Its payoff is also committed for concurrent decisions, at once or by commitPayoffs() if commits are deferred.
+ * @param [in] mst the state
+ */
+void CSOSAgent::markDirty(struct cs_State *mst)
+{
+	if (defer_commit)
+		uncommitted.push_back(mst);
+	else
+		mst->committed_payoff = mst->payoff;
+
+	if (synced_storage.empty())    // the whole memory will be dumped anyway
+		return;
+
+	dirty_states.insert(mst);
+}
+
+/**
+ * @brief Remove a state from the changed states.
+ *
+ * @param [in] mst the state
+ */
+void CSOSAgent::removeDirty(struct cs_State *mst)
+{
+	dirty_states.erase(mst);
+}
+
+/**
+ * @brief Forget all changes after the memory is in accord with a storage.
+ */
+void CSOSAgent::clearDirty() const
+{
+	dirty_states.clear();
+	deleted_states.clear();
+}
+
+/**
+ * @brief Queue a state for prioritized propagation.
+ *
+ * A state already queued keeps the higher one of the two priorities.
+ * @param [in] mst the state to be queued
+ * @param [in] pri the priority
+ */
+void CSOSAgent::queueState(struct cs_State *mst, float pri)
+{
+	std::unordered_map<cs_State *, unsigned long>::iterator it =
+			queue_positions.find(mst);
+	if (it != queue_positions.end())
+	{
+		if (priority_queue[it->second].priority >= pri)    // already queued with a higher priority
+			return;
+
+		priority_queue[it->second].priority = pri;
+		siftQueueUp(it->second);
+		return;
+	}
+
+	cs_QueuedState qs;
+	qs.priority = pri;
+	qs.state = mst;
+	priority_queue.push_back(qs);
+	queue_positions[mst] = priority_queue.size() - 1;
+	siftQueueUp(priority_queue.size() - 1);
+}
+
+/**
+ * @brief Put a queued state at a position of the heap, and record the position.
+ *
+ * @param [in] pos the position
+ * @param [in] qs the queued state
+ */
+void CSOSAgent::placeQueued(unsigned long pos, const struct cs_QueuedState &qs)
+{
+	priority_queue[pos] = qs;
+	queue_positions[qs.state] = pos;
+}
+
+/**
+ * @brief Move a queued state towards the top of the heap until its parent has a priority not lower than it.
+ *
+ * @param [in] pos position of the state
+ */
+void CSOSAgent::siftQueueUp(unsigned long pos)
+{
+	cs_QueuedState qs = priority_queue[pos];
+	while (pos > 0)
+	{
+		unsigned long parent = (pos - 1) / 2;
+		if (!(priority_queue[parent] < qs))
+			break;
+		placeQueued(pos, priority_queue[parent]);
+		pos = parent;
+	}
+	placeQueued(pos, qs);
+}
+
+/**
+ * @brief Move a queued state towards the bottom of the heap until its children have priorities not higher than it.
+ *
+ * @param [in] pos position of the state
+ */
+void CSOSAgent::siftQueueDown(unsigned long pos)
+{
+	cs_QueuedState qs = priority_queue[pos];
+	unsigned long size = priority_queue.size();
+	while (2 * pos + 1 < size)
+	{
+		unsigned long child = 2 * pos + 1;
+		if (child + 1 < size && priority_queue[child] < priority_queue[child + 1])
+			child++;
+		if (!(qs < priority_queue[child]))
+			break;
+		placeQueued(pos, priority_queue[child]);
+		pos = child;
+	}
+	placeQueued(pos, qs);
+}
+
+/**
+ * @brief Update queued states in order of priority.
+ *
+ * The payoff change of a state is propagated to its up-streaming states only when
+ * the discounted change is not less than the accuracy.
+ * @param [in] bounded whether the state and time budgets are applied
+ */
+void CSOSAgent::sweepQueue(bool bounded)
+{
+	compiled_stale = true;
+
+	std::chrono::steady_clock::time_point start =
+			std::chrono::steady_clock::now();
+	unsigned long swept = 0;
+	struct cs_BackwardLink *bas;
+
+	while (!priority_queue.empty())
+	{
+		if (bounded && state_budget > 0 && swept >= state_budget)
+			break;
+		if (bounded && time_budget > 0 && swept % 16 == 0
+				&& std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::steady_clock::now() - start).count()
+						>= (long) time_budget)    // check time every 16 states
+			break;
+
+		struct cs_State *cmst = priority_queue.front().state;
+		unqueueState(cmst);
+		swept++;
+		updated_state_num++;
+
+		float payoff = calStatePayoff(cmst);
+		float change = fabs(payoff - cmst->payoff);
+		if (change == 0.0)
+			continue;
+
+		cmst->payoff = payoff;
+		markDirty(cmst);
+		if (change_log != NULL)
+			change_log->push_back(cmst->st);
+		dbgmoreprt("SweepQueue()", "State: %" ST_FMT " change to payoff: %.3f\n", cmst->st, payoff);
+
+		float pri = discount_rate * change;    // the most that previous states can be changed by
+		if (pri < accuracy || pri == 0.0)    // change is too small to be propagated
+			continue;
+
+		for (bas = cmst->blist; bas != NULL; bas = bas->next)
+			queueState(bas->pstate, pri);
+	}
+}
+
+/**
+ * @brief Remove a state from the priority queue.
+ *
+ * @param [in] mst the state
+ */
+void CSOSAgent::unqueueState(struct cs_State *mst)
+{
+	std::unordered_map<cs_State *, unsigned long>::iterator it =
+			queue_positions.find(mst);
+	if (it == queue_positions.end())    // not queued
+		return;
+
+	// move the last one to its place
+	unsigned long pos = it->second;
+	queue_positions.erase(it);
+	cs_QueuedState last = priority_queue.back();
+	priority_queue.pop_back();
+	if (pos == priority_queue.size())    // it was the last one
+		return;
+
+	placeQueued(pos, last);
+	siftQueueUp(pos);
+	siftQueueDown(queue_positions[last.state]);
+}
+
+/**
+ * @brief A reusable barrier which blocks threads until all of them arrive.
+ */
+struct cs_SweepBarrier
+{
+		std::mutex mutex; /**< protect the counters */
+		std::condition_variable cv; /**< wake up waiting threads */
+		unsigned int thread_num; /**< number of threads to wait for */
+		unsigned int arrived; /**< number of arrived threads in current generation */
+		unsigned long generation; /**< increased every time all threads arrive */
+
+		/**
+		 * @brief Wait until all threads arrive.
+		 */
+		void wait()
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			unsigned long gen = generation;
+			if (++arrived == thread_num)    // the last one
+			{
+				arrived = 0;
+				generation++;
+				cv.notify_all();
+			}
+			else
+			{
+				while (gen == generation)
+					cv.wait(lock);
+			}
+		}
+};
+
+/**
+ * @brief Recalculate payoffs of all states in memory until they converge.
+ *
+ * States are swept in parallel with Jacobi iterations: every sweep calculates new payoffs of all states from payoffs of
+ * the previous sweep, then all new payoffs are committed at once. It stops when the maximum change of payoffs
+ * falls below the accuracy (or no changes at all if the accuracy is 0), or max_sweeps is reached.
+ * Call it after loading a memory or changing the discount rate, when payoffs in memory may be stale.
+ * @param [in] tn number of threads, 0 to use all hardware threads
+ * @param [in] ms maximum number of sweeps
+ * @return number of sweeps performed
+ */
+unsigned long CSOSAgent::recomputePayoffs(unsigned int tn, unsigned long ms)
+{
+	std::unique_lock<std::mutex> lock(learning_mutex, std::defer_lock);
+	if (learner != NULL)
+		lock.lock();
+
+	if (tn == 0)
+		tn = std::thread::hardware_concurrency();
+	if (tn == 0)    // unknown
+		tn = 1;
+
+	std::vector<cs_State *> states;
+	std::vector<float> old_payoffs;
+	states.reserve(state_num);
+	old_payoffs.reserve(state_num);
+	for (struct cs_State *mst = head; mst != NULL; mst = mst->next)
+	{
+		states.push_back(mst);
+		old_payoffs.push_back(mst->payoff);
+	}
+	std::vector<float> new_payoffs(states.size());    // payoffs calculated in the current sweep, indexed as states
+	if (tn > states.size())
+		tn = states.size() > 0 ? states.size() : 1;
+
+	compiled_stale = true;
+	cs_SweepBarrier barrier;
+	barrier.thread_num = tn;
+	barrier.arrived = 0;
+	barrier.generation = 0;
+	std::vector<float> max_changes(tn, 0.0);
+	unsigned long sweeps = 0;
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 1; i < tn; i++)
+		workers.push_back(
+				std::thread(&CSOSAgent::sweepStates, this, std::cref(states),
+						std::ref(new_payoffs), i, tn, ms, std::ref(max_changes),
+						&barrier, (unsigned long *) NULL));
+	sweepStates(states, new_payoffs, 0, tn, ms, max_changes, &barrier,
+			&sweeps);    // the calling thread works as thread 0
+
+	for (unsigned int i = 0; i < workers.size(); i++)
+		workers[i].join();
+
+	for (unsigned long i = 0; i < states.size(); i++)    // only states whose payoffs are changed need to be dumped
+		if (states[i]->payoff != old_payoffs[i])
+		{
+			markDirty(states[i]);
+			if (change_log != NULL)
+				change_log->push_back(states[i]->st);
+		}
+	updated_state_num += sweeps * states.size();
+	if (learner != NULL)
+		commitPayoffs();
+	return sweeps;
+}
+
+/**
+ * @brief Sweep a chunk of states, run by each thread of recomputePayoffs().
+ *
+ * @param [in] states all states in memory
+ * @param [in,out] new_payoffs payoffs calculated in the current sweep, indexed as states
+ * @param [in] ti index of this thread
+ * @param [in] tn number of threads
+ * @param [in] ms maximum number of sweeps
+ * @param [in,out] max_changes maximum payoff change of each thread in current sweep
+ * @param [in] bar the barrier shared by threads
+ * @param [out] sweeps number of sweeps performed, can be NULL
+ */
+void CSOSAgent::sweepStates(const std::vector<cs_State *> &states,
+		std::vector<float> &new_payoffs, unsigned int ti, unsigned int tn,
+		unsigned long ms, std::vector<float> &max_changes,
+		struct cs_SweepBarrier *bar, unsigned long *sweeps)
+{
+	unsigned long begin = states.size() * ti / tn;
+	unsigned long end = states.size() * (ti + 1) / tn;
+	float tolerance = accuracy > 0.0 ? accuracy : FLT_MIN;
+
+	unsigned long sw = 0;
+	while (sw < ms)
+	{
+		// calculate new payoffs from payoffs of the last sweep
+		for (unsigned long i = begin; i < end; i++)
+			new_payoffs[i] = calStatePayoff(states[i]);
+		bar->wait();
+
+		// commit
+		float max_change = 0.0;
+		for (unsigned long i = begin; i < end; i++)
+		{
+			float change = fabs(new_payoffs[i] - states[i]->payoff);
+			if (change > max_change)
+				max_change = change;
+			states[i]->payoff = new_payoffs[i];
+		}
+		max_changes[ti] = max_change;
+		bar->wait();
+
+		sw++;
+		// every thread makes the same decision
+		max_change = *std::max_element(max_changes.begin(), max_changes.end());
+		if (max_change < tolerance)
+			break;
+	}
+
+	if (sweeps != NULL)
+		*sweeps = sw;
+}
+
+/**
+ * @brief Choose the payoff propagation engine.
+ *
+ * States queued by prioritized propagation are all updated before switching to breadth-first propagation.
+ * @param [in] prop the propagation engine
+ * @param [in] sb maximum number of states updated per step by prioritized propagation, 0 for no limit
+ * @param [in] tb maximum microseconds spent per step by prioritized propagation, 0 for no limit
+ * @see pendingUpdates()
+ */
+void CSOSAgent::setPropagation(Propagation prop, unsigned long sb,
+		unsigned long tb)
+{
+	if (prop != PRIORITIZED)
+		sweepQueue(false);    // finish the unfinished work
+
+	propagation = prop;
+	state_budget = sb;
+	time_budget = tb;
+}
+
+/**
+ * @brief Get the number of states waiting to be updated by prioritized propagation.
+ *
+ * @return the number
+ */
+unsigned long CSOSAgent::pendingUpdates() const
+{
+	return priority_queue.size();
+}
+
+/**
+ * @brief Free the whole computer memory used by an agent.
+ *
+ * All structures are allocated from the pools, so they are released in bulk here instead of one by one.
+ */
+void CSOSAgent::freeMemory()
+{
+	// indexes are not pooled, free them first
+	struct cs_State *mst;
+	for (mst = head; mst != NULL; mst = mst->next)
+	{
+		freeActIndex(mst);
+		freeBlkIndex(mst);
+	}
+
+	state_pool.clear();
+	act_pool.clear();
+	eat_pool.clear();
+	blk_pool.clear();
+
+	head = NULL;
+	cur_mst = NULL;
+	current_st_index = NULL;
+	state_num = 0;
+	lk_num = 0;
+	mirror_num = 0;
+
+	states_map.clear();
+	update_queue.clear();
+	queue_front = 0;
+	priority_queue.clear();
+	queue_positions.clear();
+	dirty_states.clear();    // storage has to be dumped fully
+	deleted_states.clear();
+	synced_storage.clear();
+}
+
+/**
+ * @brief Free the action index of a state.
+ *
+ * @param [in] mst the state
+ */
+void CSOSAgent::freeActIndex(struct cs_State *mst)
+{
+	delete mst->actindex;
+	mst->actindex = NULL;
+}
+
+/**
+ * @brief Free the backward link index of a state.
+ *
+ * @param [in] mst the state
+ */
+void CSOSAgent::freeBlkIndex(struct cs_State *mst)
+{
+	delete mst->blkindex;
+	mst->blkindex = NULL;
+}
+
+/**
+ * @brief Delete and free a specified state from memory.
+ *
+ * @param [in] mst the state to be deleted
+ */
+void CSOSAgent::_deleteState(struct cs_State *mst)
+{
+	if (mst == NULL)
+	{
+		return;
+	}
+
+	// first, remove mst from previous states' forward links
+	struct cs_BackwardLink *blk, *nblk;
+	struct cs_Action *mac, *nmac;
+	struct cs_EnvAction *meat, *nmeat;
+	struct cs_State *pmst, *nmst;
+	for (blk = mst->blist; blk != NULL; blk = nblk)
+	{
+		pmst = blk->pstate;
+		markDirty(pmst);    // its links to mst will be gone
+		for (mac = pmst->actlist; mac != NULL; mac = nmac)
+		{
+			Agent::EnvAction eat = mst->st - pmst->st - mac->act;    // calculate the possible eat
+			deleteEat(eat, mst, mac);
+
+			nmac = mac->next;
+		}
+
+		nblk = blk->next;
+	}
+
+	// then, remove mst from following states' backward links
+	for (mac = mst->actlist; mac != NULL; mac = nmac)
+	{
+		for (meat = mac->ealist; meat != NULL; meat = nmeat)
+		{
+			nmst = meat->nstate;
+			deleteBlk(mst, nmst);
+
+			nmeat = meat->next;
+		}
+
+		nmac = mac->next;
+	}
+
+	// update lk_num
+	for (mac = mst->actlist; mac != NULL; mac = nmac)
+	{
+		for (meat = mac->ealist; meat != NULL; meat = nmeat)
+		{
 			lk_num--;    // every link from mst will be deleted
 			nmeat = meat->next;
 		}
@@ -1033,9 +1842,18 @@ void CSOSAgent::_deleteState(struct cs_State *mst)
 	if (mst->next != NULL)
 		mst->next->prev = mst->prev;
 
+	unqueueState(mst);
+	removePending(mst);
+	removeDirty(mst);
+	if (!synced_storage.empty())    // to be deleted from storage
+		deleted_states.insert(mst->st);
+
 	// remove state from hash map
 	states_map.erase(mst->st);
 	state_num--;
+	if (mst->remote)
+		mirror_num--;
+	compiled_stale = true;
 
 	return freeState(mst);
 }
@@ -1051,6 +1869,22 @@ void CSOSAgent::_deleteState(struct cs_State *mst)
 OSpace CSOSAgent::maxPayoffRule(Agent::State st, OSpace &acts) const
 {
 	dbgmoreprt("Enter MaxPayoffRule() ", "---------------------- State: %" ST_FMT "\n", st);
+	if (compiled != NULL)    // answer from the compiled memory when frozen
+	{
+		if (compiled_stale)    // memory has been changed directly, compile it again
+			compileMemory();
+
+		long si = searchCompiledState(st);
+		if (si < 0)
+			return acts;
+		else
+			return compiledBestActions(si, acts);
+	}
+
+	std::unique_lock<std::mutex> lock(memory_mutex, std::defer_lock);
+	if (learner != NULL)    // don't read links in the middle of linking, or payoffs in the middle of committing
+		lock.lock();
+
 	cur_mst = searchState(st);    // get the state struct from state value
 
 	if (cur_mst == NULL)    // first time to encounter this state, we know nothing about it, so no restriction applied, return the whole list
@@ -1060,7 +1894,7 @@ OSpace CSOSAgent::maxPayoffRule(Agent::State st, OSpace &acts) const
 	}
 	else    // we have memories about this state, find the best action of it
 	{
-		return bestActions(cur_mst, acts);
+		return bestActions(cur_mst, acts, learner != NULL);    // payoffs being propagated are not committed yet
 	}
 }
 
@@ -1192,9 +2026,12 @@ struct State_Info_Header *CSOSAgent::getStateInfo(Agent::State st) const
 void CSOSAgent::buildStateFromHeader(const State_Info_Header *sthd,
 		cs_State *mst)
 {
+	markDirty(mst);
+
 	// copy state information
 	mst->count = sthd->count;
 	mst->payoff = sthd->payoff;
+	mst->committed_payoff = sthd->payoff;
 	mst->original_payoff = sthd->original_payoff;    // the original payoff is what really is important
 
 	// copy actlist
@@ -1226,6 +2063,7 @@ void CSOSAgent::buildStateFromHeader(const State_Info_Header *sthd,
 			// build the link
 			// create this eat and add it to act
 			cs_EnvAction *meat = newEat(eaif->eat, nmst, mac);
+			mac->count += eaif->count - meat->count;    // correct the total count
 			meat->count = eaif->count;    // copy eat count
 			newBlk(mst, nmst);    // build backward link
 
@@ -1266,6 +2104,7 @@ void CSOSAgent::addStateInfo(const State_Info_Header *sthd)
 	mst = newState(sthd->st);
 
 	buildStateFromHeader(sthd, mst);
+	compiled_stale = true;
 
 	return;
 }
@@ -1309,8 +2148,11 @@ void CSOSAgent::updateStateInfo(const State_Info_Header *sthd)
 		freeAct(mac);
 	}
 	mst->actlist = NULL;    // set as NULL! It's very important!
+	mst->act_num = 0;
+	freeActIndex(mst);
 
 	buildStateFromHeader(sthd, mst);
+	compiled_stale = true;
 
 	return;
 }
@@ -1334,40 +2176,282 @@ void CSOSAgent::deleteState(State st)
 void CSOSAgent::updatePayoff(State st)
 {
 	struct cs_State *mst = searchState(st);
+	if (mst == NULL)
+		return;
+
+	if (propagation == PRIORITIZED)
+	{
+		queueState(mst, FLT_MAX);
+		return sweepQueue();
+	}
+
 	return updateStatePayoff(mst);
 }
 
 /**
- * @brief Add Memory information to memory.
+ * @brief Update payoffs affected by a specified state with the SCC solver.
  *
- * @param [in] memif the memory information to be added.
+ * It's an alternative to updatePayoff(). All up-streaming states of the specified state are
+ * collected and solved component by component, so every state out of cycles is calculated exactly once.
+ * @param [in] st the state whose payoff or links have been changed
+ * @return number of state payoff calculations done
+ * @see solveAllPayoffs()
  */
-void CSOSAgent::addMemoryInfo(const struct Memory_Info *memif)
+unsigned long CSOSAgent::solvePayoff(State st)
 {
-	UNUSED(memif);    // memory info is generated by processing, can't be directly changed.
-	return;
+	std::unique_lock<std::mutex> lock(learning_mutex, std::defer_lock);
+	if (learner != NULL)
+		lock.lock();
+
+	struct cs_State *mst = searchState(st);
+	if (mst == NULL)
+		return 0;
+
+	// collect the region: the state and all its up-streaming states
+	beginPropagation();
+	seedPropagation(mst);
+	mst->visit = update_epoch;
+	struct cs_BackwardLink *bas;
+	while (queue_front < update_queue.size())
+	{
+		struct cs_State *cmst = update_queue[queue_front++];
+		for (bas = cmst->blist; bas != NULL; bas = bas->next)
+		{
+			if (bas->pstate->visit != update_epoch)
+			{
+				bas->pstate->visit = update_epoch;
+				update_queue.push_back(bas->pstate);
+			}
+		}
+	}
+
+	unsigned long work = solveRegion();
+	if (learner != NULL)
+		commitPayoffs();
+	return work;
 }
 
 /**
- * @brief Update memory information in memory.
+ * @brief Recalculate payoffs of all states in memory with the SCC solver.
  *
- * @param [in] memif the memory information to be updated
+ * @return number of state payoff calculations done
+ * @see solvePayoff()
  */
-void CSOSAgent::updateMemoryInfo(const struct Memory_Info *memif)
+unsigned long CSOSAgent::solveAllPayoffs()
 {
-	UNUSED(memif);
-	return;
+	std::unique_lock<std::mutex> lock(learning_mutex, std::defer_lock);
+	if (learner != NULL)
+		lock.lock();
+
+	beginPropagation();
+	for (struct cs_State *mst = head; mst != NULL; mst = mst->next)
+	{
+		mst->visit = update_epoch;
+		update_queue.push_back(mst);
+	}
+
+	unsigned long work = solveRegion();
+	if (learner != NULL)
+		commitPayoffs();
+	return work;
 }
 
 /**
- * @brief Get the memory information from memory.
+ * @brief A frame of the depth-first search in the SCC solver.
+ */
+struct cs_SearchFrame
+{
+		unsigned long num; /**< number of the state being searched in the region */
+		struct cs_Action *mac; /**< the action whose outcomes are being searched */
+		struct cs_EnvAction *ea; /**< the next outcome to be searched */
+};
+
+/**
+ * @brief Solve payoffs of the states in update_queue, which are all marked by current epoch.
  *
- * @return address pointer of the memory information
+ * Strongly connected components of the region are found by an iterative Tarjan's algorithm, which
+ * emits every component after all components it leads to, so components are solved in the order they are found.
+ * States out of the region are regarded as fixed. States are numbered by their positions in update_queue,
+ * and the search keeps its marks in arrays indexed by the numbers rather than in the states.
+ * @return number of state payoff calculations done
  */
-struct Memory_Info *CSOSAgent::getMemoryInfo() const
+unsigned long CSOSAgent::solveRegion()
 {
-	struct Memory_Info *memif = (struct Memory_Info *) malloc(
-			sizeof(struct Memory_Info));
+	compiled_stale = true;
+	unsigned long region_num = update_queue.size();
+	FlatStatesMap numbers;    // number of each state in the region plus 1
+	numbers.reserve(region_num);
+	for (unsigned long n = 0; n < region_num; n++)
+		numbers.insert(update_queue[n]->st, (void *) (n + 1));
+
+	std::vector<unsigned long> scc_index(region_num, 0);    // discovery index, 0 if not discovered
+	std::vector<unsigned long> scc_low(region_num, 0);    // lowest discovery index reachable
+	std::vector<bool> scc_onstack(region_num, false);    // whether the state is on the component stack
+
+	unsigned long counter = 0, work = 0;
+	std::vector<cs_SearchFrame> frames;
+	std::vector<unsigned long> component;    // the component stack
+	std::vector<cs_State *> members;    // states of the component being solved
+	for (unsigned long rn = 0; rn < region_num; rn++)
+	{
+		if (scc_index[rn] != 0)    // already searched
+			continue;
+
+		struct cs_State *root = update_queue[rn];
+		scc_index[rn] = scc_low[rn] = ++counter;
+		scc_onstack[rn] = true;
+		component.push_back(rn);
+		cs_SearchFrame frame = { rn, root->actlist,
+				root->actlist != NULL ? root->actlist->ealist : NULL };
+		frames.push_back(frame);
+
+		while (!frames.empty())
+		{
+			cs_SearchFrame &top = frames.back();
+			while (top.mac != NULL && top.ea == NULL)    // move to the next action which has outcomes
+			{
+				top.mac = top.mac->next;
+				if (top.mac != NULL)
+					top.ea = top.mac->ealist;
+			}
+
+			if (top.mac != NULL)    // visit the next following state
+			{
+				struct cs_State *nmst = top.ea->nstate;
+				top.ea = top.ea->next;
+				if (nmst->visit != update_epoch)    // out of the region
+					continue;
+
+				unsigned long nn = (unsigned long) numbers.find(nmst->st) - 1;
+				if (scc_index[nn] == 0)    // not discovered, search it
+				{
+					scc_index[nn] = scc_low[nn] = ++counter;
+					scc_onstack[nn] = true;
+					component.push_back(nn);
+					cs_SearchFrame nframe = { nn, nmst->actlist,
+							nmst->actlist != NULL ? nmst->actlist->ealist : NULL };
+					frames.push_back(nframe);    // top is invalid from now on
+				}
+				else if (scc_onstack[nn] && scc_index[nn] < scc_low[top.num])
+					scc_low[top.num] = scc_index[nn];
+				continue;
+			}
+
+			// all following states are searched
+			unsigned long n = top.num;
+			frames.pop_back();
+			if (!frames.empty() && scc_low[n] < scc_low[frames.back().num])
+				scc_low[frames.back().num] = scc_low[n];
+
+			if (scc_low[n] == scc_index[n])    // the state is the root of a component
+			{
+				unsigned long pos = component.size();
+				members.clear();
+				do
+				{
+					--pos;
+					scc_onstack[component[pos]] = false;
+					members.push_back(update_queue[component[pos]]);
+				} while (component[pos] != n);
+				std::reverse(members.begin(), members.end());    // in the order they are found
+
+				work += solveComponent(&members[0], members.size());
+				component.resize(pos);
+			}
+		}
+	}
+
+	updated_state_num += work;
+	return work;
+}
+
+/**
+ * @brief Solve payoffs of a strongly connected component, whose following components are all solved.
+ *
+ * @param [in] states states of the component
+ * @param [in] num number of states
+ * @return number of state payoff calculations done
+ */
+unsigned long CSOSAgent::solveComponent(struct cs_State **states,
+		unsigned long num)
+{
+	if (num == 1)    // a single state is solved in one pass, unless it links to itself
+	{
+		struct cs_State *mst = states[0];
+		bool loop = false;
+		struct cs_Action *mac;
+		struct cs_EnvAction *ea;
+		for (mac = mst->actlist; mac != NULL && !loop; mac = mac->next)
+			for (ea = mac->ealist; ea != NULL && !loop; ea = ea->next)
+				loop = (ea->nstate == mst);
+
+		if (!loop)
+		{
+			float payoff = calStatePayoff(mst);
+			if (payoff != mst->payoff)
+			{
+				mst->payoff = payoff;
+				markDirty(mst);
+			}
+			return 1;
+		}
+	}
+
+	// iterate in place until no payoff changes
+	unsigned long work = 0;
+	for (unsigned long iter = 0; iter < MAX_SCC_ITERATIONS; iter++)
+	{
+		bool changed = false;
+		for (unsigned long i = 0; i < num; i++)
+		{
+			float payoff = calStatePayoff(states[i]);
+			if (payoff != states[i]->payoff)
+			{
+				states[i]->payoff = payoff;
+				markDirty(states[i]);
+				changed = true;
+			}
+		}
+		work += num;
+
+		if (!changed)
+			break;
+	}
+
+	return work;
+}
+
+/**
+ * @brief Add Memory information to memory.
+ *
+ * @param [in] memif the memory information to be added.
+ */
+void CSOSAgent::addMemoryInfo(const struct Memory_Info *memif)
+{
+	UNUSED(memif);    // memory info is generated by processing, can't be directly changed.
+	return;
+}
+
+/**
+ * @brief Update memory information in memory.
+ *
+ * @param [in] memif the memory information to be updated
+ */
+void CSOSAgent::updateMemoryInfo(const struct Memory_Info *memif)
+{
+	UNUSED(memif);
+	return;
+}
+
+/**
+ * @brief Get the memory information from memory.
+ *
+ * @return address pointer of the memory information
+ */
+struct Memory_Info *CSOSAgent::getMemoryInfo() const
+{
+	struct Memory_Info *memif = (struct Memory_Info *) malloc(
+			sizeof(struct Memory_Info));
 
 	memif->discount_rate = discount_rate;
 	memif->accuracy = accuracy;
@@ -1391,6 +2475,33 @@ std::string CSOSAgent::getMemoryName() const
 	return name;
 }
 
+/**
+ * @brief Get the total number of state payoffs recalculated by payoff propagations.
+ *
+ * @return the number
+ */
+unsigned long CSOSAgent::updatedStateNum() const
+{
+	return updated_state_num;
+}
+
+/**
+ * @brief Get the allocation statistics of memory structures.
+ *
+ * @param [out] node_allocs total number of structures allocated, which equals to the malloc calls needed without pooling
+ * @param [out] slab_allocs total number of slabs actually allocated from the system
+ */
+void CSOSAgent::getAllocationStats(unsigned long *node_allocs,
+		unsigned long *slab_allocs) const
+{
+	if (node_allocs != NULL)
+		*node_allocs = state_pool.nodeNum() + act_pool.nodeNum()
+				+ eat_pool.nodeNum() + blk_pool.nodeNum();
+	if (slab_allocs != NULL)
+		*slab_allocs = state_pool.slabNum() + act_pool.slabNum()
+				+ eat_pool.slabNum() + blk_pool.slabNum();
+}
+
 /**
  * @brief Get the first state in memory.
  *
@@ -1440,4 +2551,511 @@ bool CSOSAgent::hasState(State st) const
 		return true;
 }
 
+/**
+ * @brief Get the payoff of an action of a state, as it's calculated when deciding.
+ *
+ * @param [in] st the state
+ * @param [in] act the action
+ * @return the payoff, 0 if the state or the action is unseen
+ */
+float CSOSAgent::actionPayoff(State st, Action act) const
+{
+	struct cs_State *mst = searchState(st);
+	if (mst == NULL)
+		return 0.0;
+
+	return calActPayoff(act, mst);
+}
+
+/**
+ * @brief Find the best actions of a state for an agent session.
+ *
+ * It's thread-safe, sessions in different threads decide concurrently on committed payoffs without blocking each other,
+ * and wait only while a session is linking a transition or committing payoffs, not while it's propagating.
+ * @param [in] st the state
+ * @param [in] acts the action space of the state
+ * @return the best actions
+ * @see AgentSession
+ */
+OSpace CSOSAgent::sharedBestActions(State st, OSpace &acts) const
+{
+	if (compiled != NULL)
+	{
+		shared_lock.lockShared();
+		while (compiled_stale)    // memory has been changed directly, compile it again exclusively
+		{
+			shared_lock.unlockShared();
+			shared_lock.lock();
+			if (compiled_stale)
+				compileMemory();
+			shared_lock.unlock();
+			shared_lock.lockShared();
+		}
+		long si = searchCompiledState(st);
+		OSpace re = (si < 0) ? acts : compiledBestActions(si, acts);
+		shared_lock.unlockShared();
+		return re;
+	}
+
+	shared_lock.lockShared();
+	struct cs_State *mst = searchState(st);
+	OSpace re = (mst == NULL) ? acts : bestActions(mst, acts, true);
+	shared_lock.unlockShared();
+	return re;
+}
+
+/**
+ * @brief Learn a transition of an agent session, and propagate payoff changes.
+ *
+ * It's thread-safe, sessions learn one by one. Decisions are blocked only while the transition is linked
+ * and the changed payoffs are committed, the propagation runs without blocking them.
+ * Sessions on a ShardedAgent learn in parallel, each state range by its owner shard.
+ * Note that the shared agent itself should not be used by other ways while sessions are running.
+ * @param [in] pst the previous state of the session, INVALID_STATE if none
+ * @param [in] pact the action performed under the previous state
+ * @param [in] st the current state of the session
+ * @param [in] oripayoff original payoff of the current state
+ * @see AgentSession
+ */
+void CSOSAgent::sharedLearn(State pst, Action pact, State st, float oripayoff)
+{
+	if (compiled != NULL)    // learning is suspended when memory is frozen
+		return;
+
+	std::lock_guard<std::mutex> learning(learning_mutex);
+	shared_lock.lock();    // links are read by decisions
+	learnTransition(pst, pact, st, searchState(st), oripayoff);
+	shared_lock.unlock();
+
+	defer_commit = true;
+	propagatePending();
+	commitPayoffs();
+	defer_commit = false;
+}
+
+/**
+ * @brief Set the payoff of a state owned by another memory shard, and propagate the change.
+ *
+ * The state is created if not exists, and its payoff will never be calculated in this memory.
+ * A change which is not propagated at once leaves its up-streaming states in the batch, they are updated by the next propagation.
+ * It's thread-safe with sharedBestActions() and sharedLearn().
+ * @param [in] st the state
+ * @param [in] payoff payoff of the state in its owner shard
+ * @param [in] prop whether to propagate the change now
+ * @return true if the payoff is changed, false otherwise
+ * @see ShardedAgent
+ */
+bool CSOSAgent::mirrorState(State st, float payoff, bool prop)
+{
+	std::lock_guard<std::mutex> learning(learning_mutex);
+	shared_lock.lock();    // a new state is read by decisions
+	struct cs_State *mst = searchState(st);
+	if (mst == NULL)
+		mst = newState(st);
+	if (!mst->remote)
+	{
+		mst->remote = true;
+		mirror_num++;
+	}
+	shared_lock.unlock();
+
+	if (payoff == mst->payoff)
+		return false;
+
+	defer_commit = true;
+	mst->payoff = payoff;
+	markDirty(mst);
+	compiled_stale = true;
+	struct cs_BackwardLink *blk;
+	for (blk = mst->blist; blk != NULL; blk = blk->next)
+		addPending(blk->pstate);
+	if (prop)
+		propagatePending();
+	commitPayoffs();
+	defer_commit = false;
+	return true;
+}
+
+/**
+ * @brief Propagate payoff changes of the states left in current batch.
+ *
+ * It's thread-safe like sharedLearn().
+ * @see mirrorState()
+ */
+void CSOSAgent::sharedFlush()
+{
+	std::lock_guard<std::mutex> learning(learning_mutex);
+	defer_commit = true;
+	propagatePending();
+	commitPayoffs();
+	defer_commit = false;
+}
+
+/**
+ * @brief Check if a state is mirrored from another memory shard.
+ *
+ * @param [in] st the state
+ * @return true if it's a mirror, false if it's owned by this memory or not exists
+ */
+bool CSOSAgent::isMirror(State st) const
+{
+	struct cs_State *mst = searchState(st);
+	return mst != NULL && mst->remote;
+}
+
+/**
+ * @brief Get the number of states mirrored from other memory shards.
+ *
+ * @return the number
+ */
+unsigned long CSOSAgent::mirrorNum() const
+{
+	return mirror_num;
+}
+
+/**
+ * @brief Record states whose payoffs are changed by propagations or recalculations from now on.
+ *
+ * @param [in] cl where to append the changed states, NULL to stop recording
+ */
+void CSOSAgent::setChangeLog(std::vector<State> *cl)
+{
+	change_log = cl;
+}
+
+/**
+ * @brief Start a learner thread to learn in background.
+ *
+ * After started, update() only queues the transition, and the learner thread links states and propagates payoffs,
+ * so learning takes no time in the acting thread. The acting thread waits only if the queue is full.
+ * maxPayoffRule() reads payoffs committed after each propagation, so it sees a consistent memory and
+ * never waits for a propagation, but only for a transition being linked or payoffs being committed.
+ * Note that the learner must be stopped before accessing memory in any other way than process() and update().
+ * @param [in] qs number of transitions that can wait for the learner thread
+ * @see stopLearner()
+ */
+void CSOSAgent::startLearner(unsigned long qs)
+{
+	if (learner != NULL)    // already started
+		return;
+
+	flush();    // the learner starts from a clean batch
+	defer_commit = true;
+	transitions = new SpscQueue<cs_Transition>(qs);
+	learner_stopping = false;
+	learner = new std::thread(&CSOSAgent::learnerLoop, this);
+}
+
+/**
+ * @brief Stop the learner thread, after all queued transitions have been learned.
+ *
+ * @see startLearner()
+ */
+void CSOSAgent::stopLearner()
+{
+	if (learner == NULL)
+		return;
+
+	learner_stopping = true;
+	{
+		std::lock_guard<std::mutex> lock(learner_mutex);
+		learner_cv.notify_one();
+	}
+	learner->join();
+	delete learner;
+	learner = NULL;
+	delete transitions;
+	transitions = NULL;
+	commitPayoffs();
+	defer_commit = false;
+}
+
+/**
+ * @brief Check if the learner thread is running.
+ *
+ * @return true if running, false otherwise
+ */
+bool CSOSAgent::isLearnerRunning() const
+{
+	return learner != NULL;
+}
+
+/**
+ * @brief Main loop of the learner thread.
+ *
+ * Transitions are learned one by one, and pending states are propagated by batch size or once the queue is drained.
+ * Decisions are blocked only while a transition is linked or the changed payoffs are committed, not during propagation.
+ */
+void CSOSAgent::learnerLoop()
+{
+	cs_Transition tr;
+	unsigned long count = 0;
+	while (true)
+	{
+		bool stopping = learner_stopping;    // check before popping, so the transitions queued before stopping won't be missed
+		if (transitions->pop(tr))
+		{
+			std::lock_guard<std::mutex> learning(learning_mutex);
+			{
+				std::lock_guard<std::mutex> lock(memory_mutex);    // links are read by decisions
+				learnTransition(tr.pst, tr.pact, tr.st, searchState(tr.st),
+						tr.original_payoff);
+			}
+			if (batch_size != 0 && ++count >= batch_size)
+			{
+				count = 0;
+				propagatePending();
+				commitPayoffs();
+			}
+		}
+		else
+		{
+			if (!pending_states.empty())    // catch up while idle
+			{
+				std::lock_guard<std::mutex> learning(learning_mutex);
+				count = 0;
+				propagatePending();
+				commitPayoffs();
+			}
+
+			if (stopping)
+				break;
+
+			// sleep until a transition is queued, check again after announcing it, so the notification won't be missed
+			std::unique_lock<std::mutex> lock(learner_mutex);
+			learner_waiting = true;
+			if (transitions->empty() && !learner_stopping)
+				learner_cv.wait(lock);
+			learner_waiting = false;
+		}
+	}
+}
+
+/**
+ * @brief Commit deferred payoff changes, so they are seen by decisions of the agent and its sessions.
+ *
+ * The caller should hold learning_mutex.
+ */
+void CSOSAgent::commitPayoffs()
+{
+	std::lock_guard<std::mutex> lock(memory_mutex);
+	shared_lock.lock();
+	std::vector<cs_State *>::iterator it;
+	for (it = uncommitted.begin(); it != uncommitted.end(); ++it)
+		(*it)->committed_payoff = (*it)->payoff;
+	uncommitted.clear();
+	shared_lock.unlock();
+}
+
+/**
+ * @brief Freeze the memory for inference only.
+ *
+ * The memory is compiled into a contiguous read-only representation which maxPayoffRule() answers from.
+ * Learning is suspended until the memory is unfrozen, and current batch is flushed before freezing.
+ * @see unfreezeMemory()
+ */
+void CSOSAgent::freezeMemory()
+{
+	flush();    // the compiled memory must include changes of current batch
+
+	if (compiled == NULL)
+		compiled = new cs_CompiledMemory;
+
+	compileMemory();
+}
+
+/**
+ * @brief Unfreeze the memory and continue learning.
+ *
+ * Transitions experienced while frozen are not learned, so the time sequence restarts from the next state.
+ * @see freezeMemory()
+ */
+void CSOSAgent::unfreezeMemory()
+{
+	if (compiled == NULL)
+		return;
+
+	delete compiled;
+	compiled = NULL;
+	compiled_stale = false;
+	pre_in = INVALID_STATE;    // previous state may not exist in memory
+	pre_out = INVALID_ACTION;
+}
+
+/**
+ * @brief Check if the memory is frozen.
+ *
+ * @return true|false
+ */
+bool CSOSAgent::isFrozen() const
+{
+	return (compiled != NULL);
+}
+
+/**
+ * @brief Compare two states by their values.
+ */
+static bool stateLess(const struct cs_State *a, const struct cs_State *b)
+{
+	return a->st < b->st;
+}
+
+/**
+ * @brief Compare two actions by their values.
+ */
+static bool actionLess(const struct cs_Action *a, const struct cs_Action *b)
+{
+	return a->act < b->act;
+}
+
+/**
+ * @brief Compile the live memory into the compiled memory.
+ */
+void CSOSAgent::compileMemory() const
+{
+	assert(compiled != NULL);
+
+	// collect and sort all states
+	std::vector<cs_State *> msts;
+	msts.reserve(state_num);
+	struct cs_State *mst;
+	for (mst = head; mst != NULL; mst = mst->next)
+		msts.push_back(mst);
+	std::sort(msts.begin(), msts.end(), stateLess);
+
+	compiled->states.resize(msts.size());
+	compiled->payoffs.resize(msts.size());
+	for (unsigned long i = 0; i < msts.size(); i++)
+	{
+		compiled->states[i] = msts[i]->st;
+		compiled->payoffs[i] = msts[i]->payoff;
+	}
+
+	compiled->act_start.clear();
+	compiled->acts.clear();
+	compiled->eat_start.clear();
+	compiled->eat_probs.clear();
+	compiled->eat_nstates.clear();
+	compiled->eat_probs.reserve(lk_num);
+	compiled->eat_nstates.reserve(lk_num);
+
+	std::vector<cs_Action *> macs;
+	struct cs_Action *mac;
+	struct cs_EnvAction *ea;
+	for (unsigned long i = 0; i < msts.size(); i++)
+	{
+		compiled->act_start.push_back(compiled->acts.size());
+
+		// actions are sorted to be binary searched
+		macs.clear();
+		for (mac = msts[i]->actlist; mac != NULL; mac = mac->next)
+			macs.push_back(mac);
+		std::sort(macs.begin(), macs.end(), actionLess);
+
+		for (unsigned long j = 0; j < macs.size(); j++)
+		{
+			mac = macs[j];
+			compiled->acts.push_back(mac->act);
+			compiled->eat_start.push_back(compiled->eat_probs.size());
+
+			// outcomes keep the order of ealist, so payoffs are summed exactly as in the live memory
+			for (ea = mac->ealist; ea != NULL; ea = ea->next)
+			{
+				compiled->eat_probs.push_back(prob(ea, mac));
+				compiled->eat_nstates.push_back(
+						searchCompiledState(ea->nstate->st));
+			}
+		}
+	}
+	compiled->act_start.push_back(compiled->acts.size());
+	compiled->eat_start.push_back(compiled->eat_probs.size());
+
+	compiled_stale = false;
+	return;
+}
+
+/**
+ * @brief Search for a state in the compiled memory.
+ *
+ * @param [in] st the state to be searched
+ * @return index of the state if found, or -1 if not existing
+ */
+long CSOSAgent::searchCompiledState(Agent::State st) const
+{
+	std::vector<Agent::State>::const_iterator it = std::lower_bound(
+			compiled->states.begin(), compiled->states.end(), st);
+	if (it != compiled->states.end() && *it == st)
+		return it - compiled->states.begin();
+	else
+		return -1;
+}
+
+/**
+ * @brief Find and choose the best actions of a state from the compiled memory.
+ *
+ * Payoffs of all actions of the state are evaluated at once by the vectorised kernel,
+ * which gives exactly the same results as calActPayoff() does on the live memory.
+ * Like bestActions(), only known actions are looked up, unseen actions are added as sub-ranges of fragments.
+ * @param [in] si index of the state
+ * @param [in] acts the action space of the state
+ * @return the best actions
+ * @see bestActions()
+ */
+OSpace CSOSAgent::compiledBestActions(unsigned long si, OSpace &acts) const
+{
+	float max_payoff = -FLT_MAX;
+	OSpace best_acts;
+	static thread_local std::vector<std::pair<OSpace::ossize_t, float> > known;
+	static thread_local std::vector<float> act_payoffs;    // sessions may decide concurrently
+
+	uint32_t first = compiled->act_start[si];
+	uint32_t num = compiled->act_start[si + 1] - first;
+	act_payoffs.resize(num);
+	kernel.actionPayoffs(compiled->eat_start.data() + first, num,
+			compiled->eat_probs.data(), compiled->eat_nstates.data(),
+			compiled->payoffs.data(), act_payoffs.data());
+
+	const Agent::Action *afirst = compiled->acts.data() + first;
+	const Agent::Action *alast = afirst + num;
+	for (OSpace::ossize_t fi = 0; fi < acts.fragmentNum(); fi++)
+	{
+		const OFragment &frag = acts.fragment(fi);
+		OSpace::ossize_t size = acts.fragmentSize(fi);
+
+		known.clear();
+		if (size <= num)    // a small fragment, look up each action in it
+		{
+			for (OSpace::ossize_t p = 0; p < size; p++)
+			{
+				Agent::Action act = frag.start + frag.step * (GIOM::Output) p;
+				const Agent::Action *ap = std::lower_bound(afirst, alast, act);
+				if (ap != alast && *ap == act)
+					known.push_back(
+							std::make_pair(p,
+									trimPayoff(act_payoffs[ap - afirst])));
+			}
+		}
+		else    // a large fragment, find known actions which are in it
+		{
+			for (uint32_t j = 0; j < num; j++)
+			{
+				GIOM::Output dist = afirst[j] - frag.start;
+				if (dist % frag.step != 0)
+					continue;
+				GIOM::Output p = dist / frag.step;
+				if (p < 0 || (OSpace::ossize_t) p >= size)
+					continue;
+				known.push_back(
+						std::make_pair((OSpace::ossize_t) p,
+								trimPayoff(act_payoffs[j])));
+			}
+			if (frag.step < 0)    // actions are sorted ascending
+				std::reverse(known.begin(), known.end());
+		}
+
+		addFragmentBest(best_acts, max_payoff, frag, size, known);
+	}
+	return best_acts;
+}
+
 }    // namespace gamcs
@@ -219,7 +219,7 @@ void DotViewer::view(const char *file)
 		if (stif != NULL)
 		{
 			dotStateInfo(stif, output);
-			free(stif);
+			storage->releaseStateInfo(stif);
 			st = storage->nextState();
 		}
 		else
@@ -500,7 +500,7 @@ while (achd != NULL)
 
 			fprintf(output, "st%s [label=\"%" ST_FMT "\\n(%.2f)\"]\n", int2String(eaif->nst).c_str(),
 					eaif->nst, nstif->payoff);    // print out next state
-			free(nstif);
+			storage->releaseStateInfo(nstif);
 		}
 
 		eaif = sparser.nextEat();
@@ -509,7 +509,7 @@ while (achd != NULL)
 	achd = sparser.nextAct();
 }
 
-free(sthd);
+storage->releaseStateInfo(sthd);
 }
 else    // state not found
 {
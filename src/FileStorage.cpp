@@ -0,0 +1,583 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 30, 2014
+//
+// -----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "gamcs/FileStorage.h"
+#include "gamcs/debug.h"
+
+namespace gamcs
+{
+
+static const char FILE_MAGIC[8] = "GAMCSFS";    // identify a snapshot file
+static const size_t WRITE_BUFFER_SIZE = 1 << 20;    // states are written sequentially, so buffer a lot
+
+/**
+ * @brief Order index entries by state value.
+ */
+static bool entryLess(const fs_IndexEntry &a, const fs_IndexEntry &b)
+{
+	return a.st < b.st;
+}
+
+/**
+ * @brief The default constructor.
+ *
+ * @param [in] file the snapshot file
+ */
+FileStorage::FileStorage(std::string file) :
+		file_name(file), o_flag(O_READ), map(NULL), map_size(0), header(NULL), index(
+		NULL), cursor(0), out(NULL), out_offset(0)
+{
+	memset(&out_header, 0, sizeof(out_header));
+}
+
+/**
+ * @brief The default destructor.
+ */
+FileStorage::~FileStorage()
+{
+	if (map != NULL || out != NULL)    // not closed
+		close();
+}
+
+/**
+ * @brief Set the snapshot file.
+ *
+ * @param [in] file the file name
+ */
+void FileStorage::setFile(std::string file)
+{
+	file_name = file;
+}
+
+/**
+ * @brief Open the storage for read or write.
+ *
+ * @param [in] flag the open flag
+ * @return 0 on successfully opened, or -1 if error occurs
+ */
+int FileStorage::open(Flag flag)
+{
+	o_flag = flag;
+	cursor = 0;
+
+	if (flag == O_READ)    // open for reading
+	{
+		int ret = mapFile();
+		if (ret != 0)
+		{
+			if (ret > 0)    // not exists
+				fprintf(stderr, "Can't open file %s for reading, %s!\n",
+						file_name.c_str(), strerror(ENOENT));
+			return -1;
+		}
+		madvise(map, map_size, MADV_WILLNEED);    // all will be read when loading
+	}
+	else if (flag == O_WRITE)
+	{
+		if (mapFile() < 0)    // the old file is corrupted, don't overwrite it
+			return -1;
+
+		// the memory information is kept unless it's updated
+		memset(&out_header, 0, sizeof(out_header));
+		memcpy(out_header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+		out_header.version = FILE_VERSION;
+		out_header.state_bytes = sizeof(Agent::State);
+		if (header != NULL && header->has_memif)
+		{
+			out_header.has_memif = 1;
+			out_header.memif = header->memif;
+		}
+
+		std::string tmp_name = file_name + ".tmp";
+		out = fopen(tmp_name.c_str(), "w+b");    // read back by getStateInfo()
+		if (out == NULL)
+		{
+			fprintf(stderr, "Can't open file %s for writing, %s!\n",
+					tmp_name.c_str(), strerror(errno));
+			unmapFile();
+			return -1;
+		}
+		setvbuf(out, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+		fwrite(&out_header, sizeof(out_header), 1, out);    // rewritten when closed
+		out_offset = sizeof(out_header);
+		written.clear();
+		written_pos.clear();
+	}
+	else
+	{
+		WARNNING("Unknown storage open flag: %d!\n", flag);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Close the storage, the new file replaces the old one if opened for writing.
+ */
+void FileStorage::close()
+{
+	if (out != NULL)
+		commit();
+	unmapFile();
+}
+
+/**
+ * @brief Map the snapshot file into memory.
+ *
+ * @return 0 if mapped, 1 if the file doesn't exist, or -1 if error occurs
+ */
+int FileStorage::mapFile()
+{
+	int fd = ::open(file_name.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		if (errno == ENOENT)
+			return 1;
+		fprintf(stderr, "Can't open file %s, %s!\n", file_name.c_str(),
+				strerror(errno));
+		return -1;
+	}
+
+	struct stat sb;
+	if (fstat(fd, &sb) != 0 || (size_t) sb.st_size < sizeof(fs_FileHeader))
+	{
+		fprintf(stderr, "File %s is not a snapshot!\n", file_name.c_str());
+		::close(fd);
+		return -1;
+	}
+
+	void *addr = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);    // the mapping is kept after closing
+	if (addr == MAP_FAILED)
+	{
+		fprintf(stderr, "Can't map file %s, %s!\n", file_name.c_str(),
+				strerror(errno));
+		return -1;
+	}
+	map = (char *) addr;
+	map_size = sb.st_size;
+
+	header = (const fs_FileHeader *) map;
+	if (!checkFile())    // a truncated or corrupted file would crash when it's read
+	{
+		fprintf(stderr, "File %s is not a valid snapshot of this version!\n",
+				file_name.c_str());
+		unmapFile();
+		return -1;
+	}
+	index = (const fs_IndexEntry *) (map + header->index_offset);
+
+	return 0;
+}
+
+/**
+ * @brief Check the mapped file before trusting any offset in it.
+ *
+ * Every state information must lie between the header and the index, and the index must be sorted.
+ * @return true if the file is valid, false otherwise
+ */
+bool FileStorage::checkFile() const
+{
+	if (memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0
+			|| header->version != FILE_VERSION
+			|| header->state_bytes != sizeof(Agent::State))
+		return false;
+
+	uint64_t data_end = header->index_offset;
+	if (data_end < sizeof(fs_FileHeader) || data_end > map_size)
+		return false;
+	if (header->state_num > (map_size - data_end) / sizeof(fs_IndexEntry)    // the index is out of the file
+			|| data_end + header->state_num * sizeof(fs_IndexEntry) != map_size)
+		return false;
+
+	const fs_IndexEntry *idx = (const fs_IndexEntry *) (map + data_end);
+	for (unsigned long i = 0; i < header->state_num; i++)
+	{
+		uint64_t offset = idx[i].offset;
+		if (offset < sizeof(fs_FileHeader)
+				|| offset > data_end - sizeof(State_Info_Header))
+			return false;
+
+		const State_Info_Header *sthd = (const State_Info_Header *) (map
+				+ offset);
+		if (sthd->st != idx[i].st || sthd->size < sizeof(State_Info_Header)
+				|| sthd->size > data_end - offset)
+			return false;
+
+		if (i > 0 && idx[i - 1].st >= idx[i].st)    // binary search needs it sorted
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Unmap the snapshot file.
+ */
+void FileStorage::unmapFile()
+{
+	if (map != NULL)
+		munmap(map, map_size);
+	map = NULL;
+	map_size = 0;
+	header = NULL;
+	index = NULL;
+}
+
+/**
+ * @brief Write the unchanged states of the old file and the index to the new file, and replace the old file with it.
+ *
+ * @return 0 if done, or -1 if error occurs, in which case the old file is kept
+ */
+int FileStorage::commit()
+{
+	// the last write of each state wins
+	std::stable_sort(written.begin(), written.end(), entryLess);
+
+	std::vector<fs_IndexEntry> merged;
+	unsigned long old_num = (header != NULL) ? header->state_num : 0;
+	merged.reserve(old_num + written.size());
+
+	unsigned long i = 0, j = 0;
+	while (i < old_num || j < written.size())
+	{
+		if (j == written.size() || (i < old_num && index[i].st < written[j].st))    // unchanged, copy it
+		{
+			const State_Info_Header *sthd = (const State_Info_Header *) (map
+					+ index[i].offset);
+			fs_IndexEntry entry = { index[i].st, out_offset };
+			fwrite(sthd, sthd->size, 1, out);
+			out_offset += sthd->size;
+			merged.push_back(entry);
+			i++;
+		}
+		else
+		{
+			while (j + 1 < written.size() && written[j + 1].st == written[j].st)
+				j++;
+			if (written[j].offset != 0)    // not deleted at last
+				merged.push_back(written[j]);
+			if (i < old_num && index[i].st == written[j].st)    // replaced
+				i++;
+			j++;
+		}
+	}
+
+	// index at the end, so states can be written before they are all known
+	out_header.state_num = merged.size();
+	out_header.index_offset = out_offset;
+	if (!merged.empty())
+		fwrite(&merged[0], sizeof(fs_IndexEntry), merged.size(), out);
+	fseek(out, 0, SEEK_SET);
+	fwrite(&out_header, sizeof(out_header), 1, out);
+	fflush(out);
+
+	bool failed = ferror(out) || fsync(fileno(out)) != 0;
+	fclose(out);
+	out = NULL;
+	written.clear();
+	written_pos.clear();
+	unmapFile();
+
+	std::string tmp_name = file_name + ".tmp";
+	if (failed || rename(tmp_name.c_str(), file_name.c_str()) != 0)
+	{
+		fprintf(stderr, "Write file %s failed, %s!\n", file_name.c_str(),
+				strerror(errno));
+		remove(tmp_name.c_str());
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Search the index of the old file for a state.
+ *
+ * @param [in] st the state
+ * @return position of the state in index, or -1 if not found
+ */
+long FileStorage::searchIndex(Agent::State st) const
+{
+	if (header == NULL)
+		return -1;
+
+	// states are usually got in the order of iteration
+	if (cursor < header->state_num && index[cursor].st == st)
+		return cursor;
+
+	unsigned long lo = 0, hi = header->state_num;
+	while (lo < hi)
+	{
+		unsigned long mid = lo + (hi - lo) / 2;
+		if (index[mid].st < st)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < header->state_num && index[lo].st == st)
+		return lo;
+	return -1;
+}
+
+/**
+ * @brief Search the states written in this session for a state.
+ *
+ * @param [in] st the state
+ * @return position of the last write of the state, or -1 if not written
+ */
+long FileStorage::searchWritten(Agent::State st) const
+{
+	std::unordered_map<Agent::State, unsigned long>::const_iterator it =
+			written_pos.find(st);
+	if (it == written_pos.end())
+		return -1;
+	return it->second;
+}
+
+/**
+ * @brief Get the first state in storage.
+ *
+ * @return the first state, or INVALID_STATE if the storage is empty
+ */
+Agent::State FileStorage::firstState() const
+{
+	cursor = 0;
+	if (header == NULL || cursor >= header->state_num)
+		return Agent::INVALID_STATE;
+	return index[cursor].st;
+}
+
+/**
+ * @brief Get the next state in storage.
+ *
+ * States are iterated in ascending order.
+ * @return the next state, or INVALID_STATE if it's the end
+ */
+Agent::State FileStorage::nextState() const
+{
+	if (header == NULL || cursor + 1 >= header->state_num)
+	{
+		cursor = (header != NULL) ? header->state_num : 0;
+		return Agent::INVALID_STATE;
+	}
+	return index[++cursor].st;
+}
+
+/**
+ * @brief Check if a state exists in storage.
+ *
+ * @param [in] st the state
+ * @return true if exists, false otherwise
+ */
+bool FileStorage::hasState(Agent::State st) const
+{
+	if (out != NULL)
+	{
+		long w = searchWritten(st);
+		if (w >= 0)
+			return written[w].offset != 0;
+	}
+
+	return searchIndex(st) >= 0;
+}
+
+/**
+ * @brief Get the information of a state.
+ *
+ * The information of the old file is returned in place without copying.
+ * @param [in] st the state
+ * @return the state information, which should be released by releaseStateInfo(), or NULL if not found
+ */
+struct State_Info_Header *FileStorage::getStateInfo(Agent::State st) const
+{
+	if (out != NULL)
+	{
+		long w = searchWritten(st);
+		if (w >= 0)    // written in this session, read it back from the new file
+		{
+			if (written[w].offset == 0)    // deleted
+				return NULL;
+
+			fflush(out);
+			State_Info_Header hd;
+			if (pread(fileno(out), &hd, sizeof(hd), written[w].offset)
+					!= (ssize_t) sizeof(hd))
+				return NULL;
+			State_Info_Header *sthd = (State_Info_Header *) malloc(hd.size);
+			if (pread(fileno(out), sthd, hd.size, written[w].offset)
+					!= (ssize_t) hd.size)
+			{
+				free(sthd);
+				return NULL;
+			}
+			return sthd;
+		}
+	}
+
+	long i = searchIndex(st);
+	if (i < 0)
+		return NULL;
+	return (State_Info_Header *) (map + index[i].offset);
+}
+
+/**
+ * @brief Release a state information got by getStateInfo().
+ *
+ * @param [in] sthd the state information
+ */
+void FileStorage::releaseStateInfo(struct State_Info_Header *sthd) const
+{
+	if (map != NULL && (char *) sthd >= map && (char *) sthd < map + map_size)    // in the mapping
+		return;
+	free(sthd);
+}
+
+/**
+ * @brief Append a state information to the new file.
+ *
+ * @param [in] sthd the state information
+ */
+void FileStorage::writeStateInfo(const struct State_Info_Header *sthd)
+{
+	if (out == NULL)
+	{
+		WARNNING("FileStorage: write state %" ST_FMT " without opened for writing, ignored!\n", sthd->st);
+		return;
+	}
+
+	fs_IndexEntry entry = { sthd->st, out_offset };
+	fwrite(sthd, sthd->size, 1, out);
+	out_offset += sthd->size;
+	written_pos[entry.st] = written.size();
+	written.push_back(entry);
+}
+
+/**
+ * @brief Add a state to storage.
+ *
+ * @param [in] sthd the state information
+ */
+void FileStorage::addStateInfo(const struct State_Info_Header *sthd)
+{
+	writeStateInfo(sthd);
+}
+
+/**
+ * @brief Update a state in storage.
+ *
+ * @param [in] sthd the state information
+ */
+void FileStorage::updateStateInfo(const struct State_Info_Header *sthd)
+{
+	writeStateInfo(sthd);
+}
+
+/**
+ * @brief Add a state to storage, or update it if it exists already.
+ *
+ * Both are an append, no need to check the existence.
+ * @param [in] sthd the state information
+ */
+void FileStorage::upsertStateInfo(const struct State_Info_Header *sthd)
+{
+	writeStateInfo(sthd);
+}
+
+/**
+ * @brief Delete a state from storage.
+ *
+ * @param [in] st the state
+ */
+void FileStorage::deleteState(Agent::State st)
+{
+	if (out == NULL)
+	{
+		WARNNING("FileStorage: delete state %" ST_FMT " without opened for writing, ignored!\n", st);
+		return;
+	}
+
+	fs_IndexEntry entry = { st, 0 };    // it's gone when the file is committed
+	written_pos[st] = written.size();
+	written.push_back(entry);
+}
+
+/**
+ * @brief Get the memory information.
+ *
+ * @return the memory information, or NULL if not found
+ */
+struct Memory_Info *FileStorage::getMemoryInfo() const
+{
+	const fs_FileHeader *hd = (out != NULL) ? &out_header : header;
+	if (hd == NULL || !hd->has_memif)
+		return NULL;
+
+	struct Memory_Info *memif = (struct Memory_Info *) malloc(
+			sizeof(struct Memory_Info));
+	memcpy(memif, &hd->memif, sizeof(struct Memory_Info));
+	return memif;
+}
+
+/**
+ * @brief Add the memory information.
+ *
+ * @param [in] memif the memory information
+ */
+void FileStorage::addMemoryInfo(const struct Memory_Info *memif)
+{
+	updateMemoryInfo(memif);    // there's only one
+}
+
+/**
+ * @brief Update the memory information.
+ *
+ * @param [in] memif the memory information
+ */
+void FileStorage::updateMemoryInfo(const struct Memory_Info *memif)
+{
+	if (out == NULL)
+	{
+		WARNNING("FileStorage: update memory information without opened for writing, ignored!\n");
+		return;
+	}
+
+	memcpy(&out_header.memif, memif, sizeof(struct Memory_Info));
+	out_header.has_memif = 1;
+}
+
+/**
+ * @brief Get the memory name, which is the file name.
+ *
+ * @return the memory name
+ */
+std::string FileStorage::getMemoryName() const
+{
+	return file_name;
+}
+
+}    // namespace gamcs
@@ -0,0 +1,160 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 8, 2014
+//
+// -----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <assert.h>
+#include "gamcs/FlatStatesMap.h"
+
+namespace gamcs
+{
+
+/**
+ * The minimum number of slots.
+ */
+static const unsigned long MIN_CAPACITY = 16;
+
+/**
+ * @brief The default constructor.
+ */
+FlatStatesMap::FlatStatesMap() :
+		entries(NULL), capacity(0), mask(0), entry_num(0)
+{
+}
+
+/**
+ * @brief The default destructor.
+ */
+FlatStatesMap::~FlatStatesMap()
+{
+	free(entries);
+}
+
+/**
+ * @brief Insert an entry, the key must not exist in the map.
+ *
+ * @param [in] key the key
+ * @param [in] val the value, which must not be NULL
+ */
+void FlatStatesMap::insert(Key key, void *val)
+{
+	assert(val != NULL);
+	if (2 * (entry_num + 1) > capacity)    // keep the load factor under 0.5
+		rehash(capacity == 0 ? MIN_CAPACITY : 2 * capacity);
+
+	unsigned long i = hashMix((uint64_t) key) & mask;
+	while (entries[i].val != NULL)
+		i = (i + 1) & mask;
+	entries[i].key = key;
+	entries[i].val = val;
+	++entry_num;
+}
+
+/**
+ * @brief Remove an entry.
+ *
+ * @param [in] key the key of the entry
+ */
+void FlatStatesMap::erase(Key key)
+{
+	if (entries == NULL)
+		return;
+
+	unsigned long i = hashMix((uint64_t) key) & mask;
+	while (true)
+	{
+		if (entries[i].val == NULL)    // not found
+			return;
+		if (entries[i].key == key)
+			break;
+		i = (i + 1) & mask;
+	}
+
+	// shift the following entries backward to fill the hole
+	unsigned long j = i;
+	while (true)
+	{
+		j = (j + 1) & mask;
+		if (entries[j].val == NULL)
+			break;
+		unsigned long home = hashMix((uint64_t) entries[j].key) & mask;
+		// entry j can be moved to the hole i only if its home slot is not in (i, j]
+		if ((j > i && (home <= i || home > j))
+				|| (j < i && (home <= i && home > j)))
+		{
+			entries[i] = entries[j];
+			i = j;
+		}
+	}
+	entries[i].val = NULL;
+	--entry_num;
+}
+
+/**
+ * @brief Remove all entries and release the slots.
+ */
+void FlatStatesMap::clear()
+{
+	free(entries);
+	entries = NULL;
+	capacity = 0;
+	mask = 0;
+	entry_num = 0;
+}
+
+/**
+ * @brief Reserve slots for a number of entries, so that no rehashing happens before the map holds that many.
+ *
+ * @param [in] num the expected number of entries
+ */
+void FlatStatesMap::reserve(unsigned long num)
+{
+	unsigned long ncap = MIN_CAPACITY;
+	while (ncap < 2 * num)
+		ncap *= 2;
+
+	if (ncap > capacity)
+		rehash(ncap);
+}
+
+/**
+ * @brief Move all entries to a new array of slots.
+ *
+ * @param [in] ncap the new number of slots, must be a power of 2
+ */
+void FlatStatesMap::rehash(unsigned long ncap)
+{
+	Entry *old = entries;
+	unsigned long old_cap = capacity;
+
+	entries = (Entry *) calloc(ncap, sizeof(Entry));
+	assert(entries != NULL);
+	capacity = ncap;
+	mask = ncap - 1;
+
+	for (unsigned long k = 0; k < old_cap; k++)
+	{
+		if (old[k].val == NULL)
+			continue;
+
+		unsigned long i = hashMix((uint64_t) old[k].key) & mask;
+		while (entries[i].val != NULL)
+			i = (i + 1) & mask;
+		entries[i] = old[k];
+	}
+	free(old);
+}
+
+}    // namespace gamcs
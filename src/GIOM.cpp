@@ -22,14 +22,18 @@ namespace gamcs
 /**
  * @brief The default constructor.
  *
- * Initialize the random device.
+ * Initialize the random device, and seed the default engine from it.
  */
 GIOM::GIOM() :
 		cur_in(INVALID_INPUT), cur_out(INVALID_OUTPUT), process_count(0), rand_device(
-		NULL), max_rand_value(0)
+		NULL), max_rand_value(0), rand_engine(XOSHIRO256PP), rand_seed(0)
 {
 	rand_device = new std::random_device();    // to get true random on linux, use rand("/dev/random") instead;
 	max_rand_value = rand_device->max();    // save the maximum value
+
+	// a different seed for each run, call setSeed() to make runs reproducible
+	rand_seed = ((uint64_t) (*rand_device)() << 32) ^ (*rand_device)();
+	seedEngine();
 }
 
 /**
@@ -120,13 +124,169 @@ void GIOM::update()
  */
 gamcs_uint GIOM::randomGenerator(gamcs_uint sz) const
 {
-	std::uniform_int_distribution<gamcs_uint> dist(0, sz - 1);    // random number range: 0 ~ sz-1
+	if (rand_engine == RANDOM_DEVICE)
+	{
+		std::uniform_int_distribution<gamcs_uint> dist(0, sz - 1);    // random number range: 0 ~ sz-1
+
+		// check upper bound
+		if (max_rand_value < sz - 1)
+			WARNNING(
+					"size exceeds maximun random value potentially generated by the random-number engine\n");
+		return dist(*rand_device);
+	}
+
+	// reject the lowest 2^n % sz values, so that every result is equally likely
+	if (rand_engine == PCG32 && (uint64_t) sz <= UINT32_MAX)
+	{
+		uint32_t bound = (uint32_t) sz;
+		uint32_t threshold = (0 - bound) % bound;
+		uint32_t r;
+		do
+		{
+			r = nextRandom32();
+		} while (r < threshold);
+		return r % bound;
+	}
+
+	uint64_t bound = (uint64_t) sz;
+	uint64_t threshold = (0 - bound) % bound;
+	uint64_t r;
+	do
+	{
+		r = nextRandom64();
+	} while (r < threshold);
+	return r % bound;
+}
+
+/**
+ * @brief Select the random number engine.
+ *
+ * The engine is seeded with the current seed, so that the seed and the engine together determine the outputs.
+ * @param [in] engine the engine
+ */
+void GIOM::setRandomEngine(RandomEngine engine)
+{
+	rand_engine = engine;
+	seedEngine();
+}
+
+/**
+ * @brief Get the random number engine in use.
+ *
+ * @return the engine
+ */
+GIOM::RandomEngine GIOM::getRandomEngine() const
+{
+	return rand_engine;
+}
+
+/**
+ * @brief Seed the random number engine.
+ *
+ * Processing with the same engine, the same seed and the same inputs always produces the same outputs.
+ * It has no effect on RANDOM_DEVICE.
+ * @param [in] seed the seed
+ */
+void GIOM::setSeed(uint64_t seed)
+{
+	rand_seed = seed;
+	seedEngine();
+}
+
+/**
+ * @brief Get the seed of the random number engine, save it to reproduce a run later.
+ *
+ * @return the seed
+ */
+uint64_t GIOM::getSeed() const
+{
+	return rand_seed;
+}
+
+/**
+ * @brief Get the next value of splitmix64, used to expand a seed into engine states.
+ *
+ * @param [in,out] x the splitmix64 state
+ * @return the value
+ */
+static uint64_t splitMix64(uint64_t &x)
+{
+	uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
 
-	// check upper bound
-	if (max_rand_value < sz - 1)
-		WARNNING(
-				"size exceeds maximun random value potentially generated by the random-number engine\n");
-	return dist(*rand_device);
+/**
+ * @brief Set the engine state from the seed.
+ */
+void GIOM::seedEngine()
+{
+	uint64_t x = rand_seed;
+	for (int i = 0; i < 4; i++)
+		rand_state[i] = splitMix64(x);    // never all zeros
+
+	if (rand_engine == PCG32)    // state and increment, as pcg32_srandom()
+	{
+		uint64_t initstate = rand_state[0];
+		rand_state[1] = (rand_state[1] << 1) | 1;    // the stream, must be odd
+		rand_state[0] = 0;
+		nextRandom32();
+		rand_state[0] += initstate;
+		nextRandom32();
+	}
+}
+
+/**
+ * @brief Rotate left.
+ *
+ * @param [in] x the value
+ * @param [in] k bits to rotate, in (0, 64)
+ * @return the rotated value
+ */
+static inline uint64_t rotl64(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @brief Generate a 64 bits random number with the engine in use.
+ *
+ * @return the number
+ */
+uint64_t GIOM::nextRandom64() const
+{
+	if (rand_engine == PCG32)
+	{
+		uint64_t hi = nextRandom32();
+		return (hi << 32) | nextRandom32();
+	}
+
+	// xoshiro256++
+	uint64_t *s = rand_state;
+	uint64_t result = rotl64(s[0] + s[3], 23) + s[0];
+	uint64_t t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl64(s[3], 45);
+	return result;
+}
+
+/**
+ * @brief Generate a 32 bits random number with PCG32.
+ *
+ * @return the number
+ */
+uint32_t GIOM::nextRandom32() const
+{
+	uint64_t oldstate = rand_state[0];
+	rand_state[0] = oldstate * 6364136223846793005ULL + rand_state[1];
+	uint32_t xorshifted = (uint32_t) (((oldstate >> 18) ^ oldstate) >> 27);
+	uint32_t rot = (uint32_t) (oldstate >> 59);
+	return (xorshifted >> rot) | (xorshifted << ((0 - rot) & 31));
 }
 
 }    // namespace gamcs
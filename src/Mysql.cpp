@@ -411,6 +411,44 @@ void Mysql::updateStateInfo(const struct State_Info_Header *sthd)
 	return;
 }
 
+/**
+ * @brief Add a state to storage, or update it if it exists already, in a single query.
+ *
+ * @param [in] sthd the state information
+ */
+void Mysql::upsertStateInfo(const struct State_Info_Header *sthd)
+{
+	unsigned long act_len = sthd->size - sizeof(State_Info_Header);
+
+	char *stmt_buf = (char *) malloc(768 + 2 * act_len + 3);
+	char *ptr;
+	sprintf(stmt_buf,
+			"INSERT INTO %s(State, OriPayoff, Payoff, Count, ActNum, Size, ActInfos) VALUES(%" ST_FMT ", %f, %f, %" UINT32_FMT ", %" UINT32_FMT ", %" UINT16_FMT ",'",
+			db_t_stateinfo.c_str(), sthd->st, sthd->original_payoff,
+			sthd->payoff, sthd->count, sthd->act_num, sthd->size);
+	ptr = stmt_buf + strlen(stmt_buf);
+
+	char *stp = (char *) sthd;
+	stp += sizeof(struct State_Info_Header);    // point to the first act
+
+	ptr += mysql_real_escape_string(db_con, ptr, stp, act_len);
+	*ptr++ = '\'';
+	*ptr++ = ')';
+
+	int update_len = sprintf(ptr,
+			" ON DUPLICATE KEY UPDATE OriPayoff=VALUES(OriPayoff), Payoff=VALUES(Payoff), Count=VALUES(Count), ActNum=VALUES(ActNum), Size=VALUES(Size), ActInfos=VALUES(ActInfos)");
+	ptr += update_len;
+
+	if (mysql_real_query(db_con, (const char *) stmt_buf,
+			(unsigned long) (ptr - stmt_buf)))
+	{
+		fprintf(stderr, "%s\n", mysql_error(db_con));
+	}
+
+	free(stmt_buf);
+	return;
+}
+
 /**
  * @brief Delete a state from storage.
  *
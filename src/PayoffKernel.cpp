@@ -0,0 +1,142 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 16, 2014
+//
+// -----------------------------------------------------------------------------
+
+#include "gamcs/PayoffKernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GAMCS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace gamcs
+{
+
+/**
+ * @brief Scalar kernel of actionPayoffs().
+ */
+static void scalarActionPayoffs(const uint32_t *eat_start,
+		unsigned long act_num, const float *probs, const uint32_t *nstates,
+		const float *payoffs, float *out)
+{
+	for (unsigned long j = 0; j < act_num; j++)
+	{
+		float payoff = 0;
+		for (uint32_t k = eat_start[j]; k < eat_start[j + 1]; k++)
+			payoff += probs[k] * payoffs[nstates[k]];
+		out[j] = payoff;
+	}
+}
+
+#ifdef GAMCS_X86_KERNELS
+/**
+ * @brief AVX2 kernel of actionPayoffs(), 8 actions at a time with gathers.
+ */
+__attribute__((target("avx2")))
+static void avx2ActionPayoffs(const uint32_t *eat_start,
+		unsigned long act_num, const float *probs, const uint32_t *nstates,
+		const float *payoffs, float *out)
+{
+	unsigned long j = 0;
+	for (; j + 8 <= act_num; j += 8)
+	{
+		__m256i start = _mm256_loadu_si256((const __m256i *) (eat_start + j));
+		__m256i end = _mm256_loadu_si256(
+				(const __m256i *) (eat_start + j + 1));
+		uint32_t len = 0;
+		for (int l = 0; l < 8; l++)
+		{
+			if (eat_start[j + l + 1] - eat_start[j + l] > len)
+				len = eat_start[j + l + 1] - eat_start[j + l];
+		}
+
+		__m256 sum = _mm256_setzero_ps();
+		__m256i idx = start;
+		const __m256i one = _mm256_set1_epi32(1);
+		for (uint32_t k = 0; k < len; k++)
+		{
+			__m256i valid = _mm256_cmpgt_epi32(end, idx);    // indexes are far less than 2^31
+			__m256 mask = _mm256_castsi256_ps(valid);
+			__m256 p = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), probs, idx,
+					mask, 4);
+			__m256i ns = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+					(const int *) nstates, idx, valid, 4);
+			__m256 v = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), payoffs,
+					ns, mask, 4);
+			__m256 added = _mm256_add_ps(sum, _mm256_mul_ps(p, v));
+			sum = _mm256_blendv_ps(sum, added, mask);    // finished lanes keep their sums untouched
+			idx = _mm256_add_epi32(idx, one);
+		}
+		_mm256_storeu_ps(out + j, sum);
+	}
+
+	scalarActionPayoffs(eat_start + j, act_num - j, probs, nstates, payoffs,
+			out + j);    // the tail
+}
+#endif
+
+/**
+ * @brief The default constructor.
+ *
+ * An instruction set not supported by current CPU falls back to the best supported one below it.
+ * @param [in] is the instruction set to use
+ */
+PayoffKernel::PayoffKernel(Isa is) :
+		isa(SCALAR), act_kernel(scalarActionPayoffs)
+{
+	if (is == BEST)
+		is = AVX2;
+	while (!isSupported(is))
+		is = (Isa) (is - 1);
+
+	isa = is;
+#ifdef GAMCS_X86_KERNELS
+	if (isa == AVX2)
+		act_kernel = avx2ActionPayoffs;
+#endif
+}
+
+/**
+ * @brief Get the instruction set in use.
+ *
+ * @return the instruction set
+ */
+PayoffKernel::Isa PayoffKernel::getIsa() const
+{
+	return isa;
+}
+
+/**
+ * @brief Check if an instruction set is supported by current CPU.
+ *
+ * @param [in] is the instruction set
+ * @return true if supported, false otherwise
+ */
+bool PayoffKernel::isSupported(Isa is)
+{
+	switch (is)
+	{
+		case SCALAR:
+			return true;
+#ifdef GAMCS_X86_KERNELS
+		case AVX2:
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+}    // namespace gamcs
@@ -88,7 +88,7 @@ void PrintViewer::view(const char *file)
 		if (stif != NULL)
 		{
 			printStateInfo(stif, output);
-			free(stif);
+			storage->releaseStateInfo(stif);
 			st = storage->nextState();
 		}
 		else
@@ -168,7 +168,7 @@ void PrintViewer::viewState(Agent::State st, const char *file)
 	if (stif != NULL)
 	{
 		printStateInfo(stif, output);
-		free(stif);
+		storage->releaseStateInfo(stif);
 	}
 	else
 	{
@@ -0,0 +1,814 @@
+// -----------------------------------------------------------------------------
+//
+// GAMCS -- Generalized Agent Model and Computer Simulation
+//
+// Copyright (C) 2013-2014, Andy Huang  <andyspider@126.com>
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+//
+// -----------------------------------------------------------------------------
+//
+// Created on: Jun 23, 2014
+//
+// -----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gamcs/ShardedAgent.h"
+#include "gamcs/StateInfoParser.h"
+
+namespace gamcs
+{
+
+/**
+ * @brief The default constructor.
+ *
+ * @param [in] i the agent id
+ * @param [in] dr the discount rate
+ * @param [in] ac the accuracy
+ * @param [in] sn number of shards, [1, MAX_SHARD_NUM]
+ */
+ShardedAgent::ShardedAgent(int i, float dr, float ac, int sn) :
+		OSAgent(i, dr, ac), shard_num(sn), outstanding(0), current_shard(0), wave(
+				0)
+{
+	if (shard_num < 1 || shard_num > MAX_SHARD_NUM)
+		ERROR("ShardedAgent - number of shards must be in [1, %d]!\n",
+				MAX_SHARD_NUM);
+
+	batch_size = 0;    // learning is asynchronous, don't wait for shards every step
+
+	for (int s = 0; s < shard_num; s++)
+	{
+		sd_Shard *shard = new sd_Shard;
+		shard->memory = new CSOSAgent(i, dr, ac);
+		shard->memory->setChangeLog(&shard->changed);
+		shard->waiting = false;
+		shard->deferred = false;
+		shard->mirror_changes = 0;
+		shards.push_back(shard);
+	}
+	for (int s = 0; s < shard_num; s++)
+		shards[s]->worker = new std::thread(&ShardedAgent::workerLoop, this, s);
+}
+
+/**
+ * @brief The default destructor.
+ */
+ShardedAgent::~ShardedAgent()
+{
+	waitIdle();
+
+	sd_Message msg;
+	msg.type = MSG_STOP;
+	for (int s = 0; s < shard_num; s++)
+		post(s, msg);
+	for (int s = 0; s < shard_num; s++)
+	{
+		shards[s]->worker->join();
+		delete shards[s]->worker;
+		delete shards[s]->memory;
+		delete shards[s];
+	}
+}
+
+/**
+ * @brief Get the number of shards.
+ *
+ * @return the number
+ */
+int ShardedAgent::shardNum() const
+{
+	return shard_num;
+}
+
+/**
+ * @brief Get the shard which owns a state.
+ *
+ * @param [in] st the state
+ * @return index of the shard
+ */
+int ShardedAgent::shardOf(State st) const
+{
+	return hashMix((uint64_t) st) % shard_num;
+}
+
+/**
+ * @brief Get the number of mirrors whose payoffs differ from their owners.
+ *
+ * It waits until all shards are idle, a converged memory has no stale mirrors.
+ * @return the number of stale mirrors
+ */
+unsigned long ShardedAgent::staleMirrorNum() const
+{
+	waitIdle();
+
+	unsigned long stale = 0;
+	for (int s = 0; s < shard_num; s++)
+	{
+		CSOSAgent *memory = shards[s]->memory;
+		for (State st = memory->firstState(); st != INVALID_STATE; st =
+				memory->nextState())
+		{
+			if (!memory->isMirror(st))
+				continue;
+
+			State_Info_Header *mirror = memory->getStateInfo(st);
+			State_Info_Header *origin = shards[shardOf(st)]->memory->getStateInfo(
+					st);
+			if (origin == NULL || mirror->payoff != origin->payoff)
+				stale++;
+			free(mirror);
+			free(origin);
+		}
+	}
+	return stale;
+}
+
+/**
+ * @brief Recalculate payoffs of all states until they converge across shards.
+ *
+ * Every round, all shards recalculate payoffs of their own states in parallel with the payoffs of mirrors fixed,
+ * then the changes are pushed to the mirrors. It stops when no mirror is changed by a round, or max_rounds is reached.
+ * @param [in] mr maximum number of rounds
+ * @return number of rounds performed
+ * @see CSOSAgent::recomputePayoffs()
+ */
+unsigned long ShardedAgent::recomputePayoffs(unsigned long mr)
+{
+	waitIdle();
+
+	unsigned long rounds = 0;
+	while (rounds < mr)
+	{
+		unsigned long before = 0;
+		for (int s = 0; s < shard_num; s++)
+			before += shards[s]->mirror_changes;
+
+		sd_Message msg;
+		msg.type = MSG_RECOMPUTE;
+		msg.wave = ++wave;
+		for (int s = 0; s < shard_num; s++)
+			post(s, msg);
+		waitIdle();
+		rounds++;
+
+		unsigned long after = 0;
+		for (int s = 0; s < shard_num; s++)
+			after += shards[s]->mirror_changes;
+		if (after == before)    // converged
+			break;
+	}
+	return rounds;
+}
+
+/**
+ * @brief Send a message to a shard.
+ *
+ * @param [in] s the shard
+ * @param [in] msg the message
+ */
+void ShardedAgent::post(int s, const sd_Message &msg) const
+{
+	{
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		outstanding++;
+	}
+
+	sd_Shard *shard = shards[s];
+	std::lock_guard<std::mutex> lock(shard->mutex);
+	shard->inbox.push_back(msg);
+	shard->cv.notify_one();
+}
+
+/**
+ * @brief Wait until all messages have been handled.
+ */
+void ShardedAgent::waitIdle() const
+{
+	std::unique_lock<std::mutex> lock(idle_mutex);
+	while (outstanding != 0)
+		idle_cv.wait(lock);
+}
+
+/**
+ * @brief Main loop of a shard worker.
+ *
+ * @param [in] s the shard
+ */
+void ShardedAgent::workerLoop(int s)
+{
+	sd_Shard *shard = shards[s];
+	while (true)
+	{
+		sd_Message msg;
+		{
+			std::unique_lock<std::mutex> lock(shard->mutex);
+			while (shard->inbox.empty())
+				shard->cv.wait(lock);
+			msg = shard->inbox.front();
+			shard->inbox.pop_front();
+		}
+
+		if (msg.type != MSG_STOP)
+		{
+			handle(s, msg);
+			publishChanges(s, msg.wave);    // before finishing, so the follow-up messages are counted as outstanding
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(idle_mutex);
+			if (--outstanding == 0)
+				idle_cv.notify_all();
+		}
+
+		if (msg.type == MSG_STOP)
+			break;
+	}
+}
+
+/**
+ * @brief Handle a message in a shard worker.
+ *
+ * @param [in] s the shard
+ * @param [in] msg the message
+ */
+void ShardedAgent::handle(int s, sd_Message &msg)
+{
+	sd_Shard *shard = shards[s];
+	CSOSAgent *memory = shard->memory;
+
+	switch (msg.type)
+	{
+		case MSG_VISIT:
+			memory->sharedLearn(INVALID_STATE, INVALID_ACTION, msg.st,
+					msg.payoff);
+			break;
+		case MSG_LINK:
+		{
+			bool existed = memory->hasState(msg.nst);
+			memory->sharedLearn(msg.st, msg.act, msg.nst, msg.payoff);
+			int owner = shardOf(msg.nst);
+			if (owner != s && !existed)    // a new mirror, ask the owner for its payoff
+			{
+				memory->mirrorState(msg.nst, 0.0);
+				sd_Message sub;
+				sub.type = MSG_SUBSCRIBE;
+				sub.st = msg.nst;
+				sub.from = s;
+				sub.wave = msg.wave;
+				post(owner, sub);
+			}
+			break;
+		}
+		case MSG_SUBSCRIBE:
+		{
+			shard->subscribers[msg.st] |= (uint64_t) 1 << msg.from;
+			State_Info_Header *sthd = memory->getStateInfo(msg.st);
+			if (sthd != NULL)
+			{
+				sd_Message mir;
+				mir.type = MSG_MIRROR;
+				mir.st = msg.st;
+				mir.payoff = sthd->payoff;
+				mir.wave = msg.wave;
+				post(msg.from, mir);
+				free(sthd);
+			}
+			break;
+		}
+		case MSG_MIRROR:    // always the latest payoff of the owner, but propagated only once in a wave
+		{
+			unsigned long &last = shard->mirror_waves[msg.st];
+			bool newer = msg.wave > last;
+			if (newer)
+				last = msg.wave;
+			if (memory->mirrorState(msg.st, msg.payoff, false))
+			{
+				shard->mirror_changes++;
+				if (newer)
+					shard->waiting = true;
+				else
+					shard->deferred = true;
+			}
+
+			bool more;    // changes of a run of mirror messages are propagated together
+			{
+				std::lock_guard<std::mutex> lock(shard->mutex);
+				more = !shard->inbox.empty()
+						&& shard->inbox.front().type == MSG_MIRROR;
+			}
+			if (shard->waiting && !more)
+			{
+				shard->waiting = false;
+				shard->deferred = false;    // propagated too
+				memory->sharedFlush();
+			}
+			break;
+		}
+		case MSG_UPDATE:
+			memory->updatePayoff(msg.st);
+			break;
+		case MSG_LOAD:
+			if (memory->hasState(msg.sthd->st))    // created as a following state
+				memory->updateStateInfo(msg.sthd);
+			else
+				memory->addStateInfo(msg.sthd);
+			msg.storage->releaseStateInfo(msg.sthd);
+			break;
+		case MSG_ATTACH:
+			attachMirrors(s, msg.wave);
+			break;
+		case MSG_DUMP:
+			dumpShard(s, msg.storage);
+			break;
+		case MSG_FLUSH:
+			shard->deferred = false;
+			memory->sharedFlush();
+			break;
+		case MSG_RECOMPUTE:    // the batch is emptied first, so it's not propagated again after recalculation
+			shard->deferred = false;
+			memory->sharedFlush();
+			memory->recomputePayoffs(1);    // shards are recomputed in parallel
+			break;
+		default:
+			WARNNING("ShardedAgent: unknown message type: %d!\n", msg.type);
+			break;
+	}
+}
+
+/**
+ * @brief Tell the subscribers about payoff changes of owned states made by the last message.
+ *
+ * @param [in] s the shard
+ * @param [in] w the wave of the last message, which the changes belong to
+ */
+void ShardedAgent::publishChanges(int s, unsigned long w)
+{
+	sd_Shard *shard = shards[s];
+	if (shard->changed.empty())
+		return;
+
+	std::vector<State>::iterator it;
+	for (it = shard->changed.begin(); it != shard->changed.end(); ++it)
+	{
+		std::unordered_map<State, uint64_t>::iterator sit = shard->subscribers.find(
+				*it);
+		if (sit == shard->subscribers.end())    // nobody mirrors it
+			continue;
+
+		State_Info_Header *sthd = shard->memory->getStateInfo(*it);
+		if (sthd == NULL)
+			continue;
+		sd_Message mir;
+		mir.type = MSG_MIRROR;
+		mir.st = *it;
+		mir.payoff = sthd->payoff;
+		mir.wave = w;
+		free(sthd);
+
+		for (int t = 0; t < shard_num; t++)
+		{
+			if (sit->second & ((uint64_t) 1 << t))
+				post(t, mir);
+		}
+	}
+	shard->changed.clear();
+}
+
+/**
+ * @brief Turn states owned by other shards into mirrors, and subscribe to their owners.
+ *
+ * It's used after states are created from state information, which knows nothing about shards.
+ * @param [in] s the shard
+ * @param [in] w the wave which the payoffs of the mirrors are propagated in
+ */
+void ShardedAgent::attachMirrors(int s, unsigned long w)
+{
+	CSOSAgent *memory = shards[s]->memory;
+
+	std::vector<State> foreign;
+	for (State st = memory->firstState(); st != INVALID_STATE; st =
+			memory->nextState())
+	{
+		if (shardOf(st) != s && !memory->isMirror(st))
+			foreign.push_back(st);
+	}
+
+	std::vector<State>::iterator it;
+	for (it = foreign.begin(); it != foreign.end(); ++it)
+	{
+		memory->mirrorState(*it, 0.0);
+		sd_Message sub;
+		sub.type = MSG_SUBSCRIBE;
+		sub.st = *it;
+		sub.from = s;
+		sub.wave = w;
+		post(shardOf(*it), sub);
+	}
+}
+
+/**
+ * @brief Dump all owned states of a shard to a storage.
+ *
+ * State information is built in parallel by shards, while writing to the storage is serialized.
+ * @param [in] s the shard
+ * @param [in] storage the storage
+ */
+void ShardedAgent::dumpShard(int s, Storage *storage)
+{
+	CSOSAgent *memory = shards[s]->memory;
+	for (State st = memory->firstState(); st != INVALID_STATE; st =
+			memory->nextState())
+	{
+		if (shardOf(st) != s)    // a mirror
+			continue;
+
+		State_Info_Header *sthd = memory->getStateInfo(st);
+		std::lock_guard<std::mutex> lock(storage_mutex);
+		storage->upsertStateInfo(sthd);
+		free(sthd);
+	}
+}
+
+/**
+ * @brief The Maximum Payoff Rule, decided by the owner shard of the state.
+ *
+ * @param [in] st the state
+ * @param [in] acts the action space of the state
+ * @return the best actions
+ */
+OSpace ShardedAgent::maxPayoffRule(State st, OSpace &acts) const
+{
+	return sharedBestActions(st, acts);
+}
+
+/**
+ * @brief Send the current transition to shards.
+ *
+ * @param [in] oripayoff original payoff of current state
+ */
+void ShardedAgent::updateMemory(float oripayoff)
+{
+	sharedLearn(pre_in, pre_out, cur_in, oripayoff);
+}
+
+/**
+ * @brief Find the best actions of a state for an agent session, decided by the owner shard of the state.
+ *
+ * It's thread-safe, decisions don't block each other or the workers.
+ * @param [in] st the state
+ * @param [in] acts the action space of the state
+ * @return the best actions
+ * @see AgentSession
+ */
+OSpace ShardedAgent::sharedBestActions(State st, OSpace &acts) const
+{
+	return shards[shardOf(st)]->memory->sharedBestActions(st, acts);
+}
+
+/**
+ * @brief Send a transition of an agent session to shards.
+ *
+ * The link is learned by the owner of the previous state, the visit by the owner of the current state.
+ * It's thread-safe and returns at once, the transition is learned by the owner shards asynchronously.
+ * @param [in] pst the previous state of the session, INVALID_STATE if none
+ * @param [in] pact the action performed under the previous state
+ * @param [in] st the current state of the session
+ * @param [in] oripayoff original payoff of the current state
+ * @see AgentSession
+ */
+void ShardedAgent::sharedLearn(State pst, Action pact, State st,
+		float oripayoff)
+{
+	sd_Message msg;
+	msg.wave = ++wave;
+	int owner = shardOf(st);
+	if (pst != INVALID_STATE)
+	{
+		msg.type = MSG_LINK;
+		msg.st = pst;
+		msg.act = pact;
+		msg.nst = st;
+		msg.payoff = oripayoff;
+		post(shardOf(pst), msg);
+		if (shardOf(pst) == owner)    // the link has visited the current state too
+			return;
+	}
+
+	msg.type = MSG_VISIT;
+	msg.st = st;
+	msg.payoff = oripayoff;
+	post(owner, msg);
+}
+
+/**
+ * @brief Wait until all shards have finished learning.
+ *
+ * Changes of mirrors deferred by earlier waves are propagated in a new wave. Like a propagation in CSOSAgent,
+ * which updates every state once, the wave may defer changes again, they are propagated by the next flush.
+ */
+void ShardedAgent::flushMemory()
+{
+	waitIdle();
+
+	sd_Message msg;
+	msg.type = MSG_FLUSH;
+	msg.wave = ++wave;
+	for (int s = 0; s < shard_num; s++)
+		if (shards[s]->deferred)
+			post(s, msg);
+	waitIdle();
+}
+
+/**
+ * @brief Open the memory as a storage.
+ *
+ * @param [in] flag the open flag
+ * @return 0
+ */
+int ShardedAgent::open(Flag flag)
+{
+	UNUSED(flag);
+	waitIdle();
+	return 0;
+}
+
+/**
+ * @brief Close the memory as a storage.
+ */
+void ShardedAgent::close()
+{
+	return;
+}
+
+/**
+ * @brief Get the information of a state from its owner shard.
+ *
+ * @param [in] st the state
+ * @return the state information, NULL if not found
+ */
+State_Info_Header *ShardedAgent::getStateInfo(State st) const
+{
+	waitIdle();
+	return shards[shardOf(st)]->memory->getStateInfo(st);
+}
+
+/**
+ * @brief Add a state to its owner shard.
+ *
+ * @param [in] sthd the state information
+ */
+void ShardedAgent::addStateInfo(const struct State_Info_Header *sthd)
+{
+	waitIdle();
+	int s = shardOf(sthd->st);
+	shards[s]->memory->addStateInfo(sthd);
+	attachMirrors(s, ++wave);
+	waitIdle();
+}
+
+/**
+ * @brief Update a state in its owner shard.
+ *
+ * @param [in] sthd the state information
+ */
+void ShardedAgent::updateStateInfo(const struct State_Info_Header *sthd)
+{
+	waitIdle();
+	int s = shardOf(sthd->st);
+	shards[s]->memory->updateStateInfo(sthd);
+	attachMirrors(s, ++wave);
+	waitIdle();
+}
+
+/**
+ * @brief Delete a state from its owner shard.
+ *
+ * Mirrors of the state in other shards are kept.
+ * @param [in] st the state
+ */
+void ShardedAgent::deleteState(State st)
+{
+	waitIdle();
+	sd_Shard *shard = shards[shardOf(st)];
+	static_cast<Storage *>(shard->memory)->deleteState(st);
+	shard->subscribers.erase(st);
+}
+
+/**
+ * @brief Update payoffs starting from a specified state, and wait for the propagation to finish across shards.
+ *
+ * @param [in] st the state
+ */
+void ShardedAgent::updatePayoff(State st)
+{
+	sd_Message msg;
+	msg.type = MSG_UPDATE;
+	msg.st = st;
+	msg.wave = ++wave;
+	post(shardOf(st), msg);
+	waitIdle();
+}
+
+/**
+ * @brief Get the memory information, summed over shards.
+ *
+ * @return the memory information
+ */
+struct Memory_Info *ShardedAgent::getMemoryInfo() const
+{
+	waitIdle();
+	struct Memory_Info *memif = (struct Memory_Info *) malloc(
+			sizeof(struct Memory_Info));
+	memif->discount_rate = discount_rate;
+	memif->accuracy = accuracy;
+	memif->state_num = 0;
+	memif->lk_num = 0;
+	memif->last_st = pre_in;
+	memif->last_act = pre_out;
+
+	for (int s = 0; s < shard_num; s++)
+	{
+		struct Memory_Info *smemif = shards[s]->memory->getMemoryInfo();
+		memif->state_num += smemif->state_num
+				- shards[s]->memory->mirrorNum();    // mirrors are counted by their owners
+		memif->lk_num += smemif->lk_num;
+		free(smemif);
+	}
+	return memif;
+}
+
+/**
+ * @brief Add Memory information to memory.
+ *
+ * @param [in] memif the memory information to be added.
+ */
+void ShardedAgent::addMemoryInfo(const struct Memory_Info *memif)
+{
+	UNUSED(memif);    // memory info is generated by processing, can't be directly changed.
+	return;
+}
+
+/**
+ * @brief Update memory information in memory.
+ *
+ * @param [in] memif the memory information to be updated.
+ */
+void ShardedAgent::updateMemoryInfo(const struct Memory_Info *memif)
+{
+	UNUSED(memif);
+	return;
+}
+
+/**
+ * @brief Get the memory name.
+ *
+ * @return the name
+ */
+std::string ShardedAgent::getMemoryName() const
+{
+	char name[64];
+	sprintf(name, "Memory_of_Agent_%d", id);
+	return name;
+}
+
+/**
+ * @brief Get the first state in memory.
+ *
+ * @return the first state, INVALID_STATE if memory is empty
+ */
+Agent::State ShardedAgent::firstState() const
+{
+	waitIdle();
+	for (current_shard = 0; current_shard < shard_num; current_shard++)
+	{
+		CSOSAgent *memory = shards[current_shard]->memory;
+		for (State st = memory->firstState(); st != INVALID_STATE; st =
+				memory->nextState())
+		{
+			if (shardOf(st) == current_shard)    // skip mirrors
+				return st;
+		}
+	}
+	return INVALID_STATE;
+}
+
+/**
+ * @brief Get the next state in memory.
+ *
+ * @return the next state, INVALID_STATE if reach the end
+ */
+Agent::State ShardedAgent::nextState() const
+{
+	if (current_shard >= shard_num)
+		return INVALID_STATE;
+
+	State st = shards[current_shard]->memory->nextState();
+	while (true)
+	{
+		for (; st != INVALID_STATE;
+				st = shards[current_shard]->memory->nextState())
+		{
+			if (shardOf(st) == current_shard)
+				return st;
+		}
+
+		if (++current_shard >= shard_num)
+			return INVALID_STATE;
+		st = shards[current_shard]->memory->firstState();
+	}
+}
+
+/**
+ * @brief Check if a state exists in memory.
+ *
+ * @param [in] st the state
+ * @return true if exists, false otherwise
+ */
+bool ShardedAgent::hasState(State st) const
+{
+	waitIdle();
+	return shards[shardOf(st)]->memory->hasState(st);
+}
+
+/**
+ * @brief Load memory from a storage, states are loaded by their owner shards in parallel.
+ *
+ * @param [in] storage the storage
+ */
+void ShardedAgent::loadMemoryFromStorage(Storage *storage)
+{
+	if (storage == NULL)
+		return;
+
+	waitIdle();
+	if (storage->open(Storage::O_READ) == 0)
+	{
+		struct Memory_Info *memif = storage->getMemoryInfo();
+		if (memif != NULL)
+		{
+			discount_rate = memif->discount_rate;
+			accuracy = memif->accuracy;
+			pre_in = memif->last_st;
+			pre_out = memif->last_act;
+			free(memif);
+		}
+
+		// a storage has a single cursor and its statements can't be shared by threads, so it's read in this thread, and states are built by shards
+		sd_Message msg;
+		msg.type = MSG_LOAD;
+		msg.wave = ++wave;
+		msg.storage = storage;    // the information is released by the storage, which is kept open until all shards are idle
+		for (State st = storage->firstState(); st != INVALID_STATE; st =
+				storage->nextState())
+		{
+			msg.sthd = storage->getStateInfo(st);
+			if (msg.sthd == NULL)
+				ERROR(
+						"state: %" ST_FMT " should exist, but fetch from storage returns NULL, the database may be corrupted!\n",
+						st);
+			post(shardOf(st), msg);
+		}
+		waitIdle();
+
+		msg.type = MSG_ATTACH;
+		msg.wave = ++wave;
+		for (int s = 0; s < shard_num; s++)
+			post(s, msg);
+		waitIdle();
+	}
+	storage->close();
+}
+
+/**
+ * @brief Dump memory to a storage, states are dumped by their owner shards in parallel.
+ *
+ * @param [in] storage the storage
+ */
+void ShardedAgent::dumpMemoryToStorage(Storage *storage) const
+{
+	if (storage == NULL)
+		return;
+
+	waitIdle();
+	if (storage->open(Storage::O_WRITE) == 0)
+	{
+		struct Memory_Info *memif = getMemoryInfo();
+		storage->addMemoryInfo(memif);
+		free(memif);
+
+		sd_Message msg;
+		msg.type = MSG_DUMP;
+		msg.wave = wave;
+		msg.storage = storage;
+		for (int s = 0; s < shard_num; s++)
+			post(s, msg);
+		waitIdle();
+	}
+	storage->close();
+}
+
+}    // namespace gamcs
@@ -30,7 +30,9 @@ namespace gamcs
  */
 Sqlite::Sqlite(std::string dbname) :
 		db_con(NULL), db_name(dbname), db_t_stateinfo("StateInfo"), db_t_meminfo(
-				"MemoryInfo"), current_index(0), o_flag(O_READ)
+				"MemoryInfo"), iter_stmt(NULL), iter_row(false), row_cached(false), get_stmt(
+		NULL), has_stmt(NULL), add_stmt(NULL), update_stmt(NULL), delete_stmt(
+		NULL), upsert_stmt(NULL), o_flag(O_READ)
 {
 }
 
@@ -77,6 +79,7 @@ int Sqlite::open(Flag flag)
 
 		sqlite3_exec(db_con, "PRAGMA synchronous = NORMAL", NULL, NULL,
 				&err_msg);
+		prepareStatements();
 	}
 	else if (flag == O_WRITE)
 	{
@@ -127,6 +130,7 @@ int Sqlite::open(Flag flag)
 
 		// begin a transaction for writing mode
 		sqlite3_exec(db_con, "BEGIN TRANSACTION", NULL, NULL, &err_msg);
+		prepareStatements();
 	}
 	else
 	{
@@ -146,6 +150,10 @@ void Sqlite::close()
 		return;
 	else
 	{
+		// a connection with unfinalized statements can't be closed
+		closeCursor();
+		finalizeStatements();
+
 		if (o_flag == O_WRITE)    // end transaction for writing mode
 		{
 			sqlite3_exec(db_con, "END TRANSACTION", NULL, NULL, NULL);
@@ -156,15 +164,98 @@ void Sqlite::close()
 	}
 }
 
+/**
+ * @brief Prepare a statement on the state information table.
+ *
+ * @param [in] format the sql, with %s for the table name
+ * @return the statement, or NULL if error occurs
+ */
+sqlite3_stmt *Sqlite::prepare(const char *format) const
+{
+	char query_str[512];
+	sprintf(query_str, format, db_t_stateinfo.c_str());
+
+	sqlite3_stmt *stmt;
+	int ret = sqlite3_prepare_v2(db_con, query_str, -1, &stmt, 0);
+	if (ret != SQLITE_OK)
+	{
+		fprintf(stderr, "prepare - prepare sql error: #%d: %s\n", ret,
+				sqlite3_errmsg(db_con));
+		sqlite3_finalize(stmt);
+		return NULL;
+	}
+	return stmt;
+}
+
+/**
+ * @brief Prepare statements of state operations once the storage is opened, they are reused until it's closed.
+ */
+void Sqlite::prepareStatements()
+{
+	get_stmt = prepare(
+			"SELECT State, OriPayoff, Payoff, Count, ActNum, Size, ActInfos FROM %s WHERE State=?");
+	has_stmt = prepare("SELECT State FROM %s WHERE State=?");
+
+	if (o_flag == O_WRITE)
+	{
+		add_stmt = prepare(
+				"INSERT INTO %s(State, OriPayoff, Payoff, Count, ActNum, Size, ActInfos) VALUES(?, ?, ?, ?, ?, ?, ?)");
+		update_stmt = prepare(
+				"UPDATE %s SET OriPayoff=?, Payoff=?, Count=?, ActNum=?, Size=?, ActInfos=? WHERE State=?");
+		delete_stmt = prepare("DELETE FROM %s WHERE State=?");
+		if (sqlite3_libversion_number() >= 3024000)    // ON CONFLICT ... DO UPDATE appears in SQLite 3.24.0
+			upsert_stmt = prepare(
+					"INSERT INTO %s(State, OriPayoff, Payoff, Count, ActNum, Size, ActInfos) VALUES(?, ?, ?, ?, ?, ?, ?) ON CONFLICT(State) DO UPDATE SET OriPayoff=excluded.OriPayoff, Payoff=excluded.Payoff, Count=excluded.Count, ActNum=excluded.ActNum, Size=excluded.Size, ActInfos=excluded.ActInfos");
+	}
+}
+
+/**
+ * @brief Finalize statements of state operations.
+ */
+void Sqlite::finalizeStatements()
+{
+	// finalizing NULL is harmless
+	sqlite3_finalize(get_stmt);
+	sqlite3_finalize(has_stmt);
+	sqlite3_finalize(add_stmt);
+	sqlite3_finalize(update_stmt);
+	sqlite3_finalize(delete_stmt);
+	sqlite3_finalize(upsert_stmt);
+	get_stmt = has_stmt = add_stmt = update_stmt = delete_stmt = upsert_stmt =
+	NULL;
+}
+
 /**
  * @brief Get the first state in storage.
  *
+ * A cursor is opened over the state information table, and kept open during the iteration.
  * @return the first state
  */
 Agent::State Sqlite::firstState() const
 {
-	current_index = 0;
-	return stateByIndex(current_index);
+	if (iter_stmt == NULL)
+	{
+		char query_str[256];
+		sprintf(query_str,
+				"SELECT State, OriPayoff, Payoff, Count, ActNum, Size, ActInfos FROM %s",
+				db_t_stateinfo.c_str());
+
+		int ret = sqlite3_prepare_v2(db_con, query_str, -1, &iter_stmt, 0);
+		if (ret != SQLITE_OK)
+		{
+			fprintf(stderr, "firstState - prepare sql error: #%d: %s\n", ret,
+					sqlite3_errmsg(db_con));
+			sqlite3_finalize(iter_stmt);
+			iter_stmt = NULL;
+			return Agent::INVALID_STATE;
+		}
+	}
+	else    // restart
+	{
+		sqlite3_reset(iter_stmt);
+	}
+
+	return stepCursor();
 }
 
 /**
@@ -174,41 +265,71 @@ Agent::State Sqlite::firstState() const
  */
 Agent::State Sqlite::nextState() const
 {
-	++current_index;
-	return stateByIndex(current_index);
+	if (iter_stmt == NULL || !iter_row)    // not started or reach the end already
+		return Agent::INVALID_STATE;
+
+	return stepCursor();
 }
 
 /**
- * @brief Get a state by its index in storage.
+ * @brief Move the cursor to the next row.
  *
- * @param [in] index the index in storage
- * @return the state at that index, or INVALID_STATE if out of boundary
+ * @return state of the row, or INVALID_STATE if reach the end
  */
-Agent::State Sqlite::stateByIndex(unsigned long index) const
+Agent::State Sqlite::stepCursor() const
 {
-	Agent::State st = Agent::INVALID_STATE;
-
-	char query_str[256];
-	sprintf(query_str, "SELECT * FROM %s LIMIT %ld, 1", db_t_stateinfo.c_str(),
-			index);
-
-	sqlite3_stmt *stmt;
-	int ret = sqlite3_prepare_v2(db_con, query_str, -1, &stmt, 0);
-	if (ret != SQLITE_OK)
+	int ret = sqlite3_step(iter_stmt);
+	if (ret == SQLITE_ROW)
 	{
-		fprintf(stderr, "stateByIndex - prepare sql error: #%d: %s\n", ret,
-				sqlite3_errmsg(db_con));
-	}
-	else
-	{
-		if (sqlite3_step(stmt) == SQLITE_ROW)    // should only exists on row at most
-		{
-			st = sqlite3_column_int(stmt, 0);
-		}
+		iter_row = true;
+		row_cached = true;
+		return sqlite3_column_int64(iter_stmt, 0);
 	}
 
-	sqlite3_finalize(stmt);
-	return st;
+	if (ret != SQLITE_DONE)
+		fprintf(stderr, "stepCursor - step error: #%d: %s\n", ret,
+				sqlite3_errmsg(db_con));
+	iter_row = false;
+	row_cached = false;
+	return Agent::INVALID_STATE;
+}
+
+/**
+ * @brief Finalize the cursor used by iterator.
+ */
+void Sqlite::closeCursor() const
+{
+	sqlite3_finalize(iter_stmt);    // harmless on NULL
+	iter_stmt = NULL;
+	iter_row = false;
+	row_cached = false;
+}
+
+/**
+ * @brief Build state information from the current row of a statement.
+ *
+ * Columns of the row are State, OriPayoff, Payoff, Count, ActNum, Size, ActInfos in order.
+ * @param [in] stmt the statement
+ * @return address point of the state information
+ */
+static struct State_Info_Header *rowToStateInfo(sqlite3_stmt *stmt)
+{
+	unsigned int sthd_size = sqlite3_column_int(stmt, 5);
+	struct State_Info_Header *sthd = (State_Info_Header *) malloc(sthd_size);
+	sthd->st = sqlite3_column_int64(stmt, 0);
+	sthd->original_payoff = sqlite3_column_double(stmt, 1);
+	sthd->payoff = sqlite3_column_double(stmt, 2);
+	sthd->count = sqlite3_column_int(stmt, 3);
+	sthd->act_num = sqlite3_column_int(stmt, 4);
+	sthd->size = sthd_size;
+
+	unsigned char *stp = (unsigned char *) sthd;
+	stp += sizeof(struct State_Info_Header);
+	int acif_size = sthd_size - sizeof(State_Info_Header);
+
+	assert(acif_size == sqlite3_column_bytes(stmt, 6));
+	memcpy(stp, sqlite3_column_blob(stmt, 6), acif_size);
+	return sthd;
 }
 
 /**
@@ -225,42 +346,24 @@ struct State_Info_Header *Sqlite::getStateInfo(Agent::State st) const
 		return NULL;
 	}
 
-	struct State_Info_Header *sthd = NULL;
+	// iterating, and the state is under the cursor, no need to query again
+	if (row_cached && sqlite3_column_int64(iter_stmt, 0) == st)
+		return rowToStateInfo(iter_stmt);
 
-	char query_string[256];
-	sqlite3_stmt *stmt;
-	sprintf(query_string, "SELECT * FROM %s WHERE State=%" ST_FMT,
-			db_t_stateinfo.c_str(), st);
-
-	int ret = sqlite3_prepare_v2(db_con, query_string, -1, &stmt, 0);
-	if (ret != SQLITE_OK)
+	if (get_stmt == NULL)
 	{
-		fprintf(stderr, "getStateInfo - prepare sql error: #%d: %s\n", ret,
-				sqlite3_errmsg(db_con));
+		fprintf(stderr, "getStateInfo - storage is not opened!\n");
+		return NULL;
 	}
-	else
+
+	struct State_Info_Header *sthd = NULL;
+	sqlite3_bind_int64(get_stmt, 1, st);
+	if (sqlite3_step(get_stmt) == SQLITE_ROW)
 	{
-		if (sqlite3_step(stmt) == SQLITE_ROW)
-		{
-			unsigned int sthd_size = sqlite3_column_int(stmt, 5);
-			sthd = (State_Info_Header *) malloc(sthd_size);
-			sthd->st = sqlite3_column_int(stmt, 0);
-			sthd->original_payoff = sqlite3_column_double(stmt, 1);
-			sthd->payoff = sqlite3_column_double(stmt, 2);
-			sthd->count = sqlite3_column_int(stmt, 3);
-			sthd->act_num = sqlite3_column_int(stmt, 4);
-			sthd->size = sthd_size;
-
-			unsigned char *stp = (unsigned char *) sthd;
-			stp += sizeof(struct State_Info_Header);
-			int acif_size = sthd_size - sizeof(State_Info_Header);
-
-			assert(acif_size == sqlite3_column_bytes(stmt, 6));
-			memcpy(stp, sqlite3_column_blob(stmt, 6), acif_size);
-		}
+		sthd = rowToStateInfo(get_stmt);
 	}
 
-	sqlite3_finalize(stmt);
+	sqlite3_reset(get_stmt);
 	return sthd;
 }
 
@@ -272,27 +375,19 @@ struct State_Info_Header *Sqlite::getStateInfo(Agent::State st) const
  */
 bool Sqlite::hasState(Agent::State st) const
 {
-	bool result = false;
+	if (row_cached && sqlite3_column_int64(iter_stmt, 0) == st)    // the state under the cursor
+		return true;
 
-	char query_string[256];
-	sprintf(query_string, "SELECT * FROM %s WHERE State=%" ST_FMT,
-			db_t_stateinfo.c_str(), st);
-	sqlite3_stmt *stmt;
-	int ret = sqlite3_prepare_v2(db_con, query_string, -1, &stmt, 0);
-	if (ret != SQLITE_OK)
+	if (has_stmt == NULL)
 	{
-		fprintf(stderr, "hasState - prepare sql error: %d: %s\n", ret,
-				sqlite3_errmsg(db_con));
-	}
-	else
-	{
-		if (sqlite3_step(stmt) == SQLITE_ROW)
-		{
-			result = true;
-		}
+		fprintf(stderr, "hasState - storage is not opened!\n");
+		return false;
 	}
 
-	sqlite3_finalize(stmt);
+	sqlite3_bind_int64(has_stmt, 1, st);
+	bool result = (sqlite3_step(has_stmt) == SQLITE_ROW);
+
+	sqlite3_reset(has_stmt);
 	return result;
 }
 
@@ -305,43 +400,39 @@ bool Sqlite::hasState(Agent::State st) const
  */
 void Sqlite::addStateInfo(const struct State_Info_Header *sthd)
 {
-	unsigned long act_len = sthd->size - sizeof(State_Info_Header);
-
-	char *stmt_buf = (char *) malloc(512 + 2 * act_len + 3);
-	sprintf(stmt_buf,
-			"INSERT INTO %s(State, OriPayoff, Payoff, Count, ActNum, Size, ActInfos) VALUES(%" ST_FMT ", %f, %f, %" UINT32_FMT ", %" UINT32_FMT ", %" UINT16_FMT ", ?)",
-			db_t_stateinfo.c_str(), sthd->st, sthd->original_payoff,
-			sthd->payoff, sthd->count, sthd->act_num, sthd->size);
+	row_cached = false;
+	if (add_stmt == NULL)
+	{
+		fprintf(stderr, "addStateInfo - storage is not opened for writing!\n");
+		return;
+	}
 
+	unsigned long act_len = sthd->size - sizeof(State_Info_Header);
 	char *stp = (char *) sthd;
 	stp += sizeof(State_Info_Header);    // point to the first action
 
-	sqlite3_stmt *stmt;
-	int ret = sqlite3_prepare_v2(db_con, stmt_buf, -1, &stmt, 0);
+	// the leftmost argument is 1
+	sqlite3_bind_int64(add_stmt, 1, sthd->st);
+	sqlite3_bind_double(add_stmt, 2, sthd->original_payoff);
+	sqlite3_bind_double(add_stmt, 3, sthd->payoff);
+	sqlite3_bind_int64(add_stmt, 4, sthd->count);
+	sqlite3_bind_int64(add_stmt, 5, sthd->act_num);
+	sqlite3_bind_int(add_stmt, 6, sthd->size);
+	int ret = sqlite3_bind_blob(add_stmt, 7, stp, act_len, SQLITE_STATIC);
 	if (ret != SQLITE_OK)
 	{
-		fprintf(stderr, "addStateInfo - prepare sql error: %d: %s\n", ret,
+		fprintf(stderr, "addStateInfo - bind blob failed: %s\n",
 				sqlite3_errmsg(db_con));
 	}
 	else
 	{
-		ret = sqlite3_bind_blob(stmt, 1, stp, act_len, SQLITE_STATIC);    // the leftmost argument is 1
-		if (ret != SQLITE_OK)
-		{
-			fprintf(stderr, "addStateInfo - bind blob failed: %s\n",
+		ret = sqlite3_step(add_stmt);
+		if (ret != SQLITE_DONE)
+			fprintf(stderr, "addStateInfo - execution insert failed: %s\n",
 					sqlite3_errmsg(db_con));
-		}
-		else
-		{
-			ret = sqlite3_step(stmt);
-			if (ret != SQLITE_DONE)
-				fprintf(stderr, "addStateInfo - execution insert failed: %s\n",
-						sqlite3_errmsg(db_con));
-		}
 	}
 
-	sqlite3_finalize(stmt);
-	free(stmt_buf);
+	sqlite3_reset(add_stmt);
 	return;
 }
 
@@ -354,45 +445,82 @@ void Sqlite::addStateInfo(const struct State_Info_Header *sthd)
  */
 void Sqlite::updateStateInfo(const struct State_Info_Header *sthd)
 {
+	row_cached = false;    // the row under the cursor may be changed
+	if (update_stmt == NULL)
+	{
+		fprintf(stderr,
+				"updateStateInfo - storage is not opened for writing!\n");
+		return;
+	}
+
 	unsigned long act_len = sthd->size - sizeof(State_Info_Header);
+	char *stp = (char *) sthd;
+	stp += sizeof(State_Info_Header);    // point to the first action
+
+	sqlite3_bind_double(update_stmt, 1, sthd->original_payoff);
+	sqlite3_bind_double(update_stmt, 2, sthd->payoff);
+	sqlite3_bind_int64(update_stmt, 3, sthd->count);
+	sqlite3_bind_int64(update_stmt, 4, sthd->act_num);
+	sqlite3_bind_int(update_stmt, 5, sthd->size);
+	sqlite3_bind_int64(update_stmt, 7, sthd->st);
+	int ret = sqlite3_bind_blob(update_stmt, 6, stp, act_len, SQLITE_STATIC);
+	if (ret != SQLITE_OK)
+	{
+		fprintf(stderr, "updateStateInfo - bind blob failed: %s\n",
+				sqlite3_errmsg(db_con));
+	}
+	else
+	{
+		ret = sqlite3_step(update_stmt);
+		if (ret != SQLITE_DONE)
+			fprintf(stderr, "updateStateInfo - execution insert failed: %s\n",
+					sqlite3_errmsg(db_con));
+	}
 
-	char *stmt_buf = (char *) malloc(512 + 2 * act_len + 3);
+	sqlite3_reset(update_stmt);
+	return;
+}
 
-	sprintf(stmt_buf,
-			"UPDATE %s SET OriPayoff=%f, Payoff=%f, Count=%" UINT32_FMT ", ActNum=%" UINT32_FMT ", Size=%" UINT16_FMT ", ActInfos=? WHERE State=%" ST_FMT,
-			db_t_stateinfo.c_str(), sthd->original_payoff, sthd->payoff,
-			sthd->count, sthd->act_num, sthd->size, sthd->st);
+/**
+ * @brief Add a state to storage, or update it if it exists already, in a single statement.
+ *
+ * Without the upsert statement (SQLite older than 3.24.0), it checks the existence first as Storage does.
+ * @param [in] sthd the state information
+ */
+void Sqlite::upsertStateInfo(const struct State_Info_Header *sthd)
+{
+	row_cached = false;
+	if (upsert_stmt == NULL)
+	{
+		Storage::upsertStateInfo(sthd);
+		return;
+	}
 
+	unsigned long act_len = sthd->size - sizeof(State_Info_Header);
 	char *stp = (char *) sthd;
 	stp += sizeof(State_Info_Header);    // point to the first action
 
-	sqlite3_stmt *stmt;
-	int ret = sqlite3_prepare_v2(db_con, stmt_buf, -1, &stmt, 0);
+	sqlite3_bind_int64(upsert_stmt, 1, sthd->st);
+	sqlite3_bind_double(upsert_stmt, 2, sthd->original_payoff);
+	sqlite3_bind_double(upsert_stmt, 3, sthd->payoff);
+	sqlite3_bind_int64(upsert_stmt, 4, sthd->count);
+	sqlite3_bind_int64(upsert_stmt, 5, sthd->act_num);
+	sqlite3_bind_int(upsert_stmt, 6, sthd->size);
+	int ret = sqlite3_bind_blob(upsert_stmt, 7, stp, act_len, SQLITE_STATIC);
 	if (ret != SQLITE_OK)
 	{
-		fprintf(stderr, "updateStateInfo - prepare sql error: %d: %s\n", ret,
+		fprintf(stderr, "upsertStateInfo - bind blob failed: %s\n",
 				sqlite3_errmsg(db_con));
 	}
 	else
 	{
-		ret = sqlite3_bind_blob(stmt, 1, stp, act_len, SQLITE_STATIC);
-		if (ret != SQLITE_OK)
-		{
-			fprintf(stderr, "updateStateInfo - bind blob failed: %s\n",
+		ret = sqlite3_step(upsert_stmt);
+		if (ret != SQLITE_DONE)
+			fprintf(stderr, "upsertStateInfo - execution upsert failed: %s\n",
 					sqlite3_errmsg(db_con));
-		}
-		else
-		{
-			ret = sqlite3_step(stmt);
-			if (ret != SQLITE_DONE)
-				fprintf(stderr,
-						"updateStateInfo - execution insert failed: %s\n",
-						sqlite3_errmsg(db_con));
-		}
 	}
 
-	sqlite3_finalize(stmt);
-	free(stmt_buf);
+	sqlite3_reset(upsert_stmt);
 	return;
 }
 
@@ -404,18 +532,20 @@ void Sqlite::updateStateInfo(const struct State_Info_Header *sthd)
  */
 void Sqlite::deleteState(Agent::State st)
 {
-	char query_string[256];
-	sprintf(query_string, "DELETE FROM %s WHERE State=%" ST_FMT,
-			db_t_stateinfo.c_str(), st);    // build delete query
+	row_cached = false;
+	if (delete_stmt == NULL)
+	{
+		fprintf(stderr, "deleteState - storage is not opened for writing!\n");
+		return;
+	}
 
-	char *err_msg;
-	int ret = sqlite3_exec(db_con, query_string, NULL, 0, &err_msg);
-	if (ret != SQLITE_OK)
+	sqlite3_bind_int64(delete_stmt, 1, st);
+	if (sqlite3_step(delete_stmt) != SQLITE_DONE)
 	{
-		fprintf(stderr, "delete state failed: %s\n", err_msg);
+		fprintf(stderr, "delete state failed: %s\n", sqlite3_errmsg(db_con));
 	}
 
-	sqlite3_free(err_msg);
+	sqlite3_reset(delete_stmt);
 	return;
 }
 
@@ -515,8 +645,8 @@ struct Memory_Info *Sqlite::getMemoryInfo() const
 			memif->accuracy = sqlite3_column_double(stmt, 3);
 			memif->state_num = sqlite3_column_int(stmt, 4);
 			memif->lk_num = sqlite3_column_int(stmt, 5);
-			memif->last_st = sqlite3_column_int(stmt, 6);
-			memif->last_act = sqlite3_column_int(stmt, 7);
+			memif->last_st = sqlite3_column_int64(stmt, 6);
+			memif->last_act = sqlite3_column_int64(stmt, 7);
 		}
 	}
 
@@ -0,0 +1,88 @@
+/*
+ * Wanderer.h
+ *
+ *  The avatar wandering in a state space with sparse rewards, and the clocks, shared by tests.
+ */
+
+#ifndef WANDERER_H_
+#define WANDERER_H_
+#include <sys/time.h>
+#include <stdlib.h>
+#include "gamcs/Avatar.h"
+
+using namespace gamcs;
+
+/**
+ * An avatar wandering in a state space with sparse rewards.
+ *
+ * It starts from state id % state_num, and an action leads to one of 3 states picked by its own random seed,
+ * so avatars with the same id walk the same path under the same actions.
+ */
+class Wanderer: public Avatar
+{
+    public:
+        /**
+         * @param id id of the avatar
+         * @param sn number of states
+         * @param an number of actions
+         * @param rd whether the outcome of an action is random, or always the same
+         */
+        Wanderer(int id, int sn, int an, bool rd = true) :
+                Avatar(id), st(id % sn), seed(id + 1), state_num(sn), action_num(
+                        an), random(rd)
+        {
+        }
+
+        void performAction(Agent::Action act)
+        {
+            st = (st * 31 + act * 7 + (random ? rand_r(&seed) % 3 : 1))
+                    % state_num;
+        }
+
+    protected:
+        Agent::State st;
+        unsigned int seed;
+        int state_num;
+        int action_num;
+        bool random;
+
+        Agent::State perceiveState()
+        {
+            return st;
+        }
+
+        OSpace availableActions(Agent::State st)
+        {
+            UNUSED(st);
+            OSpace acts;
+            acts.add(0, action_num - 1, 1);
+            return acts;
+        }
+
+        float originalPayoff(Agent::State st)
+        {
+            return (st % 97 == 0) ? 10 : -1;
+        }
+};
+
+/**
+ * Wall clock time in seconds.
+ */
+inline double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/**
+ * Wall clock time in microseconds.
+ */
+inline long nowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+#endif /* WANDERER_H_ */
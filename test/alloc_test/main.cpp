@@ -0,0 +1,95 @@
+/*
+ * main.cpp
+ *
+ *  Count heap allocations made by Avatar::step() once all states and links have been learned.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include "gamcs/CSOSAgent.h"
+#include "gamcs/Avatar.h"
+
+using namespace gamcs;
+
+const int STATE_NUM = 100;
+const int ACTION_NUM = 4;
+const int WARMUP_STEPS = 100000;
+const int STEPS = 100000;
+
+static unsigned long allocations = 0;
+
+void *operator new(size_t size)
+{
+    ++allocations;
+    void *p = malloc(size);
+    if (p == NULL)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+/**
+ * A deterministic avatar in a small state space.
+ */
+class Walker: public Avatar
+{
+    public:
+        Walker() :
+                Avatar(1), st(0)
+        {
+        }
+
+    private:
+        Agent::State st;
+
+        Agent::State perceiveState()
+        {
+            return st;
+        }
+
+        void performAction(Agent::Action act)
+        {
+            st = (st * 7 + act + 1) % STATE_NUM;
+        }
+
+        OSpace availableActions(Agent::State st)
+        {
+            UNUSED(st);
+            OSpace acts;
+            acts.add(0, ACTION_NUM - 1, 1);
+            return acts;
+        }
+
+        float originalPayoff(Agent::State st)
+        {
+            return (st == STATE_NUM / 2) ? 10 : -1;
+        }
+};
+
+int main(void)
+{
+    CSOSAgent agent(1, 0.9, 0.01);
+    agent.setSeed(1);
+    Walker walker;
+    walker.connectAgent(&agent);
+
+    // explore, so that every link is learned
+    agent.setMode(Agent::EXPLORE);
+    for (int i = 0; i < WARMUP_STEPS; i++)
+        walker.step();
+
+    printf("Warm-up steps: %d, heap allocations: %lu\n", WARMUP_STEPS,
+            allocations);
+    unsigned long before = allocations;
+    agent.setMode(Agent::ONLINE);
+    for (int i = 0; i < STEPS; i++)
+        walker.step();
+
+    printf("Steps: %d, heap allocations: %lu\n", STEPS, allocations - before);
+    return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * main.cpp
+ *
+ *  Measure dumping a memory to a snapshot file and loading it back, compared with a Sqlite database,
+ *  and check the loaded memory is the same as the dumped one, after dumping changes as well.
+ *  Usage: file_test [steps]
+ */
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include "gamcs/CSOSAgent.h"
+#include "Wanderer.h"
+#if !defined(_WIN32)
+#include "gamcs/FileStorage.h"
+#endif
+#ifdef _SQLITE_FOUND_
+#include "gamcs/Sqlite.h"
+#endif
+
+using namespace gamcs;
+
+const int STATE_NUM = 100000;
+const int ACTION_NUM = 4;
+const char *FILE_NAME = "file_test.gsf";
+const char *DB_NAME = "file_test.db";
+
+/**
+ * Read all bytes of a file.
+ */
+std::string readFile(const char *name)
+{
+    std::string bytes;
+    FILE *fp = fopen(name, "rb");
+    if (fp == NULL)
+        return bytes;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        bytes.append(buf, n);
+    fclose(fp);
+    return bytes;
+}
+
+/**
+ * Load a memory from storage, and count states which differ from the agent.
+ */
+unsigned long loadAndCompare(CSOSAgent &agent, Storage *storage,
+        const char *name)
+{
+    CSOSAgent loaded(1, 0.9, 0.01);
+    double start = now();
+    loaded.loadMemoryFromStorage(storage);
+    printf("Load from %s: %.3f secs\n", name, now() - start);
+
+    unsigned long diff = 0, num = 0;
+    for (Agent::State st = agent.firstState(); st != Agent::INVALID_STATE; st =
+            agent.nextState())
+    {
+        num++;
+        State_Info_Header *a = agent.getStateInfo(st);
+        State_Info_Header *b = loaded.getStateInfo(st);
+        if (b == NULL || a->payoff != b->payoff || a->count != b->count
+                || a->original_payoff != b->original_payoff
+                || a->act_num != b->act_num || a->size != b->size)
+            diff++;
+        free(a);
+        free(b);
+    }
+
+    Memory_Info *memif = loaded.getMemoryInfo();
+    if (memif->state_num != num)    // states deleted in memory are left in storage
+        diff += labs((long) memif->state_num - (long) num);
+    free(memif);
+    return diff;
+}
+
+int main(int argc, char *argv[])
+{
+#if !defined(_WIN32)
+    int steps = 50000;
+    if (argc > 1)
+        steps = atoi(argv[1]);
+
+    CSOSAgent agent(1, 0.9, 0.01);
+    agent.setSeed(1);
+    agent.setMode(Agent::EXPLORE);
+    Wanderer wanderer(0, STATE_NUM, ACTION_NUM, false);
+    wanderer.connectAgent(&agent);
+    for (int i = 0; i < steps; i++)
+        wanderer.step();
+
+    double start = 0;
+#ifdef _SQLITE_FOUND_
+    remove(DB_NAME);
+    Sqlite db(DB_NAME);
+    start = now();
+    agent.dumpMemoryToStorage(&db);
+    printf("Dump to sqlite: %.3f secs\n", now() - start);
+    printf("Differences: %lu\n", loadAndCompare(agent, &db, "sqlite"));
+    remove(DB_NAME);
+#endif
+
+    remove(FILE_NAME);
+    FileStorage file(FILE_NAME);
+    start = now();
+    agent.dumpMemoryToStorage(&file);
+    printf("Dump to file: %.3f secs\n", now() - start);
+    printf("Differences: %lu\n", loadAndCompare(agent, &file, "file"));
+
+    // learn more and delete some states, then dump the changes only, since the file is the last one dumped to
+    for (int i = 0; i < 1000; i++)
+        wanderer.step();
+    for (Agent::State st = 0; st < STATE_NUM; st += 9973)
+        if (agent.hasState(st))
+            static_cast<Storage *>(&agent)->deleteState(st);
+    start = now();
+    agent.dumpChangesToStorage(&file);
+    printf("Dump changes to file: %.3f secs\n", now() - start);
+    printf("Differences: %lu\n", loadAndCompare(agent, &file, "file"));
+
+    // a truncated file is rejected instead of being read out of the mapping, and it's not overwritten by writing either
+    struct stat sb;
+    stat(FILE_NAME, &sb);
+    if (truncate(FILE_NAME, sb.st_size / 2) == 0)
+    {
+        std::string truncated = readFile(FILE_NAME);
+        printf("Open truncated file: %s\n",
+                file.open(Storage::O_READ) == 0 ? "accepted" : "rejected");
+        file.close();
+        printf("Open truncated file for writing: %s\n",
+                file.open(Storage::O_WRITE) == 0 ? "accepted" : "rejected");
+        file.close();
+        printf("Truncated file: %s\n",
+                readFile(FILE_NAME) == truncated ? "unchanged" : "overwritten");
+    }
+    remove(FILE_NAME);
+
+    // states written in a session can be found before they are indexed
+    file.open(Storage::O_WRITE);
+    State_Info_Header *sthd = agent.getStateInfo(agent.firstState());
+    file.upsertStateInfo(sthd);
+    State_Info_Header *back = file.getStateInfo(sthd->st);
+    printf("Read back in writing: %s\n",
+            (back != NULL && back->size == sthd->size) ? "ok" : "failed");
+    file.releaseStateInfo(back);
+    free(sthd);
+    file.close();
+
+    remove(FILE_NAME);
+#else
+    UNUSED(argc);
+    UNUSED(argv);
+    printf("FileStorage is not supported on this platform!\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * main.cpp
+ *
+ *  Compare decision latency of a frozen (compiled) memory against the live memory.
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "gamcs/CSOSAgent.h"
+
+using namespace gamcs;
+
+const int STATE_NUM = 1000;
+const int ACTION_NUM = 64;
+const int DECISIONS = 200000;
+
+long elapsedUs(struct timeval &start, struct timeval &end)
+{
+    return (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+}
+
+long decide(CSOSAgent &agent, OSpace &acts)
+{
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < DECISIONS; i++)
+    {
+        agent.process(i % STATE_NUM, acts);
+    }
+    gettimeofday(&end, NULL);
+    return elapsedUs(start, end);
+}
+
+int main(void)
+{
+    CSOSAgent agent(1, 0.9, 0.01);
+    OSpace acts;
+    acts.add(0, ACTION_NUM - 1, 1);
+
+    // build memory: every state has all actions performed, each leading to a few outcomes
+    srand(1);
+    State_Info_Header *sthd = (State_Info_Header *) malloc(
+            sizeof(State_Info_Header)
+                    + ACTION_NUM
+                            * (sizeof(Action_Info_Header)
+                                    + 4 * sizeof(EnvAction_Info)));
+    for (int st = 0; st < STATE_NUM; st++)
+    {
+        sthd->st = st;
+        sthd->original_payoff = rand() % 10;
+        sthd->payoff = sthd->original_payoff;
+        sthd->count = 1;
+        sthd->act_num = ACTION_NUM;
+        unsigned char *p = (unsigned char *) sthd + sizeof(State_Info_Header);
+        for (int a = 0; a < ACTION_NUM; a++)
+        {
+            Action_Info_Header *athd = (Action_Info_Header *) p;
+            athd->act = a;
+            athd->eat_num = 1 + rand() % 4;
+            p += sizeof(Action_Info_Header);
+            int base = rand() % STATE_NUM;
+            for (uint32_t e = 0; e < athd->eat_num; e++)
+            {
+                EnvAction_Info *eaif = (EnvAction_Info *) p;
+                eaif->nst = (base + e) % STATE_NUM;
+                eaif->eat = eaif->nst - st - a;
+                eaif->count = 1 + rand() % 5;
+                p += sizeof(EnvAction_Info);
+            }
+        }
+        sthd->size = p - (unsigned char *) sthd;
+        if (agent.hasState(st))    // may be created as a following state
+            agent.updateStateInfo(sthd);
+        else
+            agent.addStateInfo(sthd);
+    }
+    free(sthd);
+
+    for (int st = 0; st < STATE_NUM; st++)
+        agent.updatePayoff(st);
+
+    long live_us = decide(agent, acts);
+    agent.freezeMemory();
+    long frozen_us = decide(agent, acts);
+
+    printf("States: %d, actions per state: %d, decisions: %d\n", STATE_NUM,
+            ACTION_NUM, DECISIONS);
+    printf("Live memory:   %.3f us per decision\n", 1.0 * live_us / DECISIONS);
+    printf("Frozen memory: %.3f us per decision\n",
+            1.0 * frozen_us / DECISIONS);
+
+    return 0;
+}
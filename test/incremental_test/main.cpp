@@ -0,0 +1,126 @@
+/*
+ * main.cpp
+ *
+ *  Compare dumping the whole memory with dumping only its changes to a Sqlite database,
+ *  and check the database is the same as memory after the changes are dumped.
+ *  Usage: incremental_test [steps] [more_steps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "gamcs/CSOSAgent.h"
+#include "Wanderer.h"
+#ifdef _SQLITE_FOUND_
+#include "gamcs/Sqlite.h"
+#endif
+
+using namespace gamcs;
+
+const int STATE_NUM = 100000;
+const int ACTION_NUM = 4;
+const char *DB_NAME = "incremental_test.db";
+
+#ifdef _SQLITE_FOUND_
+/**
+ * Count states which differ between memory and the database, including deleted states left in the database.
+ */
+unsigned long compare(CSOSAgent &agent, Sqlite &db,
+        const std::vector<Agent::State> &deleted)
+{
+    CSOSAgent loaded(1, 0.9, 0.01);
+    loaded.loadMemoryFromStorage(&db);
+
+    unsigned long diff = 0, num = 0;
+    for (Agent::State st = agent.firstState(); st != Agent::INVALID_STATE; st =
+            agent.nextState())
+    {
+        num++;
+        State_Info_Header *a = agent.getStateInfo(st);
+        State_Info_Header *b = loaded.getStateInfo(st);
+        if (b == NULL || a->payoff != b->payoff || a->count != b->count
+                || a->original_payoff != b->original_payoff
+                || a->act_num != b->act_num || a->size != b->size)
+            diff++;
+        free(a);
+        free(b);
+    }
+
+    unsigned long loaded_num = 0;
+    for (Agent::State st = loaded.firstState(); st != Agent::INVALID_STATE;
+            st = loaded.nextState())
+        loaded_num++;
+    if (loaded_num != num)
+        diff += labs((long) loaded_num - (long) num);
+
+    for (unsigned long i = 0; i < deleted.size(); i++)
+        if (loaded.hasState(deleted[i]))    // left in database
+            diff++;
+    return diff;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+#ifdef _SQLITE_FOUND_
+    int steps = 50000, more_steps = 1000;
+    if (argc > 1)
+        steps = atoi(argv[1]);
+    if (argc > 2)
+        more_steps = atoi(argv[2]);
+
+    CSOSAgent agent(1, 0.9, 0.01);
+    agent.setSeed(1);
+    agent.setMode(Agent::EXPLORE);
+    Wanderer wanderer(0, STATE_NUM, ACTION_NUM, false);
+    wanderer.connectAgent(&agent);
+    for (int i = 0; i < steps; i++)
+        wanderer.step();
+
+    remove(DB_NAME);
+    Sqlite db(DB_NAME);
+    double start = now();
+    agent.dumpChangesToStorage(&db);    // never dumped, the whole memory is dumped
+    printf("First dump: %.3f secs, dirty states left: %lu\n", now() - start,
+            agent.dirtyStateNum());
+
+    // only states whose payoffs are changed by a recomputation are dumped
+    agent.recomputePayoffs();
+    agent.dumpChangesToStorage(&db);
+    agent.recomputePayoffs();
+    printf("Dirty states after recomputing a solved memory: %lu\n",
+            agent.dirtyStateNum());
+
+    for (int i = 0; i < more_steps; i++)
+        wanderer.step();
+    // delete some states, they should be deleted from database too
+    std::vector<Agent::State> deleted_states;
+    for (Agent::State st = 0; st < STATE_NUM; st += 9973)
+        if (agent.hasState(st))
+        {
+            static_cast<Storage *>(&agent)->deleteState(st);
+            deleted_states.push_back(st);
+        }
+    unsigned long dirty = agent.dirtyStateNum(), deleted =
+            agent.deletedStateNum();
+
+    start = now();
+    agent.dumpChangesToStorage(&db);
+    printf("Dump changes: %lu changed, %lu deleted, %.3f secs\n", dirty,
+            deleted, now() - start);
+    printf("Differences after dumping changes: %lu\n", compare(agent, db, deleted_states));
+
+    start = now();
+    agent.dumpMemoryToStorage(&db);
+    printf("Dump whole memory: %.3f secs\n", now() - start);
+    printf("Differences after dumping whole memory: %lu\n",
+            compare(agent, db, deleted_states));
+
+    remove(DB_NAME);
+#else
+    UNUSED(argc);
+    UNUSED(argv);
+    printf("Sqlite is not found!\n");
+#endif
+    return 0;
+}
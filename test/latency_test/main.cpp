@@ -0,0 +1,90 @@
+/*
+ * main.cpp
+ *
+ *  Measure the step latency percentiles of an avatar with and without the background learner,
+ *  and check that both learn the same payoffs from the same transitions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <algorithm>
+#include "gamcs/CSOSAgent.h"
+#include "Wanderer.h"
+
+using namespace gamcs;
+
+const int STATE_NUM = 5000;
+const int ACTION_NUM = 8;
+const int STEPS = 20000;
+
+void run(bool background)
+{
+    CSOSAgent agent(1, 0.9, 0.01);
+    Wanderer wanderer(0, STATE_NUM, ACTION_NUM);
+    wanderer.connectAgent(&agent);
+    if (background)
+        agent.startLearner();
+
+    std::vector<long> latency(STEPS);
+    long start = nowUs();
+    for (int i = 0; i < STEPS; i++)
+    {
+        long t = nowUs();
+        wanderer.step();
+        latency[i] = nowUs() - t;
+    }
+    long elapsed = nowUs() - start;
+    agent.stopLearner();
+
+    std::sort(latency.begin(), latency.end());
+    printf("%-20s p50: %4ld us, p90: %4ld us, p99: %5ld us, max: %6ld us, total: %ld ms\n",
+            background ? "Background learner:" : "Synchronous:",
+            latency[STEPS / 2], latency[STEPS * 9 / 10],
+            latency[STEPS * 99 / 100], latency[STEPS - 1], elapsed / 1000);
+}
+
+/**
+ * Learn the same transitions with and without the background learner, and count the states whose payoffs differ.
+ */
+void compareLearned()
+{
+    CSOSAgent sync(1, 0.9, 0.01), background(1, 0.9, 0.01);
+    CSOSAgent *agents[2] = { &sync, &background };
+    for (int a = 0; a < 2; a++)
+    {
+        agents[a]->setMode(Agent::EXPLORE);    // random actions by the same seed, decisions won't affect the path
+        agents[a]->setSeed(7);
+        if (a == 1)
+            agents[a]->startLearner();
+        Wanderer wanderer(0, STATE_NUM, ACTION_NUM);
+        wanderer.connectAgent(agents[a]);
+        for (int i = 0; i < STEPS; i++)
+            wanderer.step();
+        agents[a]->stopLearner();
+    }
+
+    int diff = 0;
+    for (Agent::State st = sync.firstState(); st != Agent::INVALID_STATE; st =
+            sync.nextState())
+    {
+        State_Info_Header *ex = sync.getStateInfo(st);
+        State_Info_Header *sthd = background.getStateInfo(st);
+        if (sthd == NULL || sthd->payoff != ex->payoff)
+            diff++;
+        free(ex);
+        free(sthd);
+    }
+    printf("Learned payoffs differ in %d states\n", diff);
+}
+
+int main(void)
+{
+    printf("Steps: %d, states: %d, actions: %d\n", STEPS, STATE_NUM,
+            ACTION_NUM);
+    run(false);
+    run(true);
+    compareLearned();
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+/*
+ * main.cpp
+ *
+ *  Measure iteration and indexed access of an output space made of many fragments.
+ *  Usage: ospace_test [fragments]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gamcs/GIOM.h"
+#include "Wanderer.h"
+
+using namespace gamcs;
+
+const int ROUNDS = 10;
+
+int main(int argc, char *argv[])
+{
+    int frag_num = 10000;
+    if (argc > 1)
+        frag_num = atoi(argv[1]);
+
+    // single outputs which can't be merged, and some ranges
+    OSpace acts;
+    long expected = 0;
+    for (int i = 0; i < frag_num; i++)
+    {
+        if (i % 10 == 0)
+        {
+            acts.add(i * 100, i * 100 + 9, 3);    // 0, 3, 6, 9
+            expected += 4 * (i * 100) + 18;
+        }
+        else
+        {
+            acts.add(i * 100);
+            expected += i * 100;
+        }
+    }
+    printf("Fragments: %d, outputs: %" GAMCS_UINT_FMT "\n", frag_num,
+            acts.size());
+
+    // iterate with first() and next()
+    double start = now();
+    long sum = 0;
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        for (GIOM::Output act = acts.first(); act != GIOM::INVALID_OUTPUT;
+                act = acts.next())
+            sum += act;
+    }
+    double secs = now() - start;
+    printf("Iteration:    %10.0f outputs/sec, %s\n",
+            ROUNDS * acts.size() / secs,
+            sum == expected * ROUNDS ? "correct" : "WRONG");
+
+    // random access with operator[]
+    start = now();
+    long sum2 = 0;
+    for (int r = 0; r < ROUNDS; r++)
+    {
+        for (OSpace::ossize_t i = 0; i < acts.size(); i++)
+            sum2 += acts[(i * 7919) % acts.size()];
+    }
+    secs = now() - start;
+    printf("Random index: %10.0f outputs/sec, %s\n",
+            ROUNDS * acts.size() / secs,
+            sum2 == expected * ROUNDS ? "correct" : "WRONG");
+
+    // an assigned space has the cursor of a new one, not the cursor of the old one
+    OSpace copy;
+    for (int i = 0; i < 3; i++)
+        copy.add(i * 10);
+    copy.first();
+    copy.next();
+    copy.next();
+    copy = acts;
+    OSpace fresh(acts);
+    printf("Assignment:   %s\n",
+            copy.next() == fresh.next() && copy.first() == acts[0] ?
+                    "correct" : "WRONG");
+
+    // choose outputs randomly, as a GIOM does
+    GIOM giom;
+    giom.setSeed(1);
+    start = now();
+    long calls = ROUNDS * acts.size();
+    for (long i = 0; i < calls; i++)
+        giom.process(0, acts);
+    secs = now() - start;
+    printf("Process:      %10.0f calls/sec\n", calls / secs);
+
+    return 0;
+}
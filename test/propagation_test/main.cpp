@@ -0,0 +1,51 @@
+/*
+ * main.cpp
+ *
+ *  Measure the payoff propagation throughput of CSOSAgent in states per second.
+ *  Usage: propagation_test [batch_size]
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "gamcs/CSOSAgent.h"
+#include "Wanderer.h"
+
+using namespace gamcs;
+
+const int STATE_NUM = 5000;
+const int ACTION_NUM = 8;
+const int STEPS = 20000;
+
+int main(int argc, char *argv[])
+{
+    CSOSAgent agent(1, 0.9, 0.01);
+    if (argc > 1)
+        agent.setBatchSize(atol(argv[1]));
+    Wanderer wanderer(0, STATE_NUM, ACTION_NUM);
+    wanderer.connectAgent(&agent);
+
+    srand(1);
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    for (int i = 0; i < STEPS; i++)
+    {
+        Agent::Action act = rand() % ACTION_NUM;
+        wanderer.teach(act);
+        wanderer.performAction(act);    // teach() leaves the action to be performed by us
+    }
+    agent.flush();
+    gettimeofday(&end, NULL);
+
+    double secs = (end.tv_sec - start.tv_sec)
+            + (end.tv_usec - start.tv_usec) / 1000000.0;
+    unsigned long updated = agent.updatedStateNum();
+    printf("Steps: %d, states in memory: %d, batch size: %lu\n", STEPS,
+            STATE_NUM, agent.getBatchSize());
+    printf("Elapsed time: %.3f seconds\n", secs);
+    printf("States updated: %lu, %.0f per step\n", updated,
+            1.0 * updated / STEPS);
+    printf("Propagation throughput: %.0f states/sec\n", updated / secs);
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+/*
+ * main.cpp
+ *
+ *  Compare process() throughput of each random number engine, and check that seeded engines are reproducible.
+ *  Usage: random_test [calls]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "gamcs/GIOM.h"
+#include "Wanderer.h"
+
+using namespace gamcs;
+
+const int OUTPUT_NUM = 10;
+
+/* check that two GIOMs with the same engine and seed give the same outputs */
+bool reproducible(GIOM::RandomEngine engine, OSpace &outputs)
+{
+    GIOM a, b;
+    a.setRandomEngine(engine);
+    b.setRandomEngine(engine);
+    a.setSeed(12345);
+    b.setSeed(a.getSeed());
+
+    for (int i = 0; i < 10000; i++)
+    {
+        if (a.process(i, outputs) != b.process(i, outputs))
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    long calls = 1000000;
+    if (argc > 1)
+        calls = atol(argv[1]);
+
+    OSpace outputs;
+    outputs.add(0, OUTPUT_NUM - 1, 1);
+
+    const char *names[] = { "xoshiro256++", "pcg32", "random_device" };
+    GIOM::RandomEngine engines[] = { GIOM::XOSHIRO256PP, GIOM::PCG32,
+            GIOM::RANDOM_DEVICE };
+
+    printf("Calls: %ld, outputs: %d\n", calls, OUTPUT_NUM);
+    for (int e = 0; e < 3; e++)
+    {
+        GIOM giom;
+        giom.setRandomEngine(engines[e]);
+        giom.setSeed(1);
+
+        long hist[OUTPUT_NUM] = { 0 };
+        double start = now();
+        for (long i = 0; i < calls; i++)
+            hist[giom.process(i, outputs)]++;
+        double secs = now() - start;
+
+        // the largest deviation from a uniform histogram
+        double dev = 0;
+        for (int i = 0; i < OUTPUT_NUM; i++)
+        {
+            double d = (double) hist[i] * OUTPUT_NUM / calls - 1;
+            if (d < 0)
+                d = -d;
+            if (d > dev)
+                dev = d;
+        }
+
+        printf("%-14s %12.0f calls/sec, max deviation: %.4f, reproducible: %s\n",
+                names[e], calls / secs, dev,
+                reproducible(engines[e], outputs) ? "yes" : "no");
+    }
+
+    return 0;
+}
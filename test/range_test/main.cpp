@@ -0,0 +1,164 @@
+/*
+ * main.cpp
+ *
+ *  Check that deciding over action ranges gives the same actions as deciding over every single action,
+ *  and measure decisions over a huge action range.
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "gamcs/CSOSAgent.h"
+#include "gamcs/Avatar.h"
+
+using namespace gamcs;
+
+const int STATE_NUM = 50;
+const int ACTION_NUM = 200;
+const int STEPS = 20000;
+const int DECISIONS = 100000;
+
+double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/**
+ * An avatar exploring actions in [0, ACTION_NUM).
+ */
+class Explorer: public Avatar
+{
+    public:
+        Explorer() :
+                Avatar(1), st(0)
+        {
+        }
+
+    private:
+        Agent::State st;
+
+        Agent::State perceiveState()
+        {
+            return st;
+        }
+
+        void performAction(Agent::Action act)
+        {
+            st = (st * 31 + act) % STATE_NUM;
+        }
+
+        OSpace availableActions(Agent::State st)
+        {
+            UNUSED(st);
+            OSpace acts;
+            acts.add(0, ACTION_NUM - 1, 1);
+            return acts;
+        }
+
+        float originalPayoff(Agent::State st)
+        {
+            return (st % 7 == 0) ? 5 : -1;
+        }
+};
+
+/* the same outputs, one fragment for each */
+OSpace singles(const OSpace &acts)
+{
+    OSpace re;
+    for (GIOM::Output out = acts.first(); out != GIOM::INVALID_OUTPUT; out =
+            acts.next())
+        re.add(out, out, 1);
+    return re;
+}
+
+bool sameOutputs(const OSpace &a, const OSpace &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (OSpace::ossize_t i = 0; i < a.size(); i++)
+    {
+        if (a[i] != b[i])
+            return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    CSOSAgent agent(1, 0.9, 0.01);
+    agent.setSeed(1);
+    agent.setMode(Agent::EXPLORE);
+    Explorer explorer;
+    explorer.connectAgent(&agent);
+    for (int i = 0; i < STEPS; i++)
+        explorer.step();
+
+    // spaces with ranges of both directions, steps and repeated outputs
+    OSpace spaces[4];
+    spaces[0].add(0, ACTION_NUM - 1, 1);
+    spaces[1].add(ACTION_NUM + 50, -50, -1);
+    spaces[2].add(0, ACTION_NUM * 2, 3);
+    spaces[2].add(10, 20, 1);
+    spaces[2].add(15);
+    spaces[3].add(5, 5 + ACTION_NUM / 4, 1);    // partly known, unseen actions may win
+
+    int checked = 0, wrong = 0;
+    for (Agent::State st = 0; st < STATE_NUM; st++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            OSpace reference = singles(spaces[i]);
+            OSpace best = agent.sharedBestActions(st, spaces[i]);
+            OSpace expected = agent.sharedBestActions(st, reference);
+            checked++;
+            if (!sameOutputs(best, expected))
+                wrong++;
+        }
+    }
+    printf("Checked: %d, wrong: %d\n", checked, wrong);
+
+    // decide over a huge action range
+    OSpace huge;
+    huge.add(0, 1000000000, 1);
+    double start = now();
+    unsigned long outputs = 0;
+    for (int i = 0; i < DECISIONS; i++)
+        outputs += agent.sharedBestActions(i % STATE_NUM, huge).size();
+    double secs = now() - start;
+    printf("Huge range: %.0f decisions/sec, %.1f best actions on average\n",
+            DECISIONS / secs, (double) outputs / DECISIONS);
+
+    // the same on the compiled memory of a frozen agent
+    OSpace live[STATE_NUM][4];
+    for (Agent::State st = 0; st < STATE_NUM; st++)
+        for (int i = 0; i < 4; i++)
+            live[st][i] = agent.sharedBestActions(st, spaces[i]);
+    agent.freezeMemory();
+    checked = 0;
+    wrong = 0;
+    for (Agent::State st = 0; st < STATE_NUM; st++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            OSpace reference = singles(spaces[i]);
+            OSpace best = agent.sharedBestActions(st, spaces[i]);
+            OSpace expected = agent.sharedBestActions(st, reference);
+            checked++;
+            if (!sameOutputs(best, expected) || !sameOutputs(best, live[st][i]))
+                wrong++;
+        }
+    }
+    printf("Frozen checked: %d, wrong: %d\n", checked, wrong);
+
+    start = now();
+    outputs = 0;
+    for (int i = 0; i < DECISIONS; i++)
+        outputs += agent.sharedBestActions(i % STATE_NUM, huge).size();
+    secs = now() - start;
+    printf("Frozen huge range: %.0f decisions/sec, %.1f best actions on average\n",
+            DECISIONS / secs, (double) outputs / DECISIONS);
+
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * main.cpp
+ *
+ *  Measure the whole-memory payoff recomputation on a synthetic memory with different numbers of threads.
+ *  Usage: recompute_test [state_num] [max_threads]
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "gamcs/CSOSAgent.h"
+
+using namespace gamcs;
+
+const int ACTION_NUM = 2;
+const int OUTCOME_NUM = 2;
+
+long nowUs()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Build a memory in which every state has a few actions leading to random states, payoffs are left uncalculated.
+ */
+void buildMemory(CSOSAgent &agent, long state_num)
+{
+    srand(1);
+    State_Info_Header *sthd = (State_Info_Header *) malloc(
+            sizeof(State_Info_Header)
+                    + ACTION_NUM
+                            * (sizeof(Action_Info_Header)
+                                    + OUTCOME_NUM * sizeof(EnvAction_Info)));
+    for (long st = 0; st < state_num; st++)
+    {
+        sthd->st = st;
+        sthd->original_payoff = (st % 100 == 0) ? 10 : -1;
+        sthd->payoff = 0;
+        sthd->count = 1;
+        sthd->act_num = ACTION_NUM;
+        unsigned char *p = (unsigned char *) sthd + sizeof(State_Info_Header);
+        for (int a = 0; a < ACTION_NUM; a++)
+        {
+            Action_Info_Header *athd = (Action_Info_Header *) p;
+            athd->act = a;
+            athd->eat_num = OUTCOME_NUM;
+            p += sizeof(Action_Info_Header);
+            for (int e = 0; e < OUTCOME_NUM; e++)
+            {
+                EnvAction_Info *eaif = (EnvAction_Info *) p;
+                eaif->nst = (st + 1 + rand() % 1000) % state_num;    // mostly forward, with loops at the end
+                eaif->eat = eaif->nst - st - a;
+                eaif->count = 1 + rand() % 5;
+                p += sizeof(EnvAction_Info);
+            }
+        }
+        sthd->size = p - (unsigned char *) sthd;
+        if (agent.hasState(st))    // may be created as a following state
+            agent.updateStateInfo(sthd);
+        else
+            agent.addStateInfo(sthd);
+    }
+    free(sthd);
+}
+
+int main(int argc, char *argv[])
+{
+    long state_num = 5000000;
+    unsigned int max_threads = std::thread::hardware_concurrency();
+    if (argc > 1)
+        state_num = atol(argv[1]);
+    if (argc > 2)
+        max_threads = atoi(argv[2]);
+    if (max_threads == 0)
+        max_threads = 1;
+
+    printf("States: %ld, actions per state: %d, outcomes per action: %d\n",
+            state_num, ACTION_NUM, OUTCOME_NUM);
+
+    long base_us = 0;
+    for (unsigned int tn = 1; tn <= max_threads; tn *= 2)
+    {
+        CSOSAgent agent(1, 0.9, 0.01);
+        buildMemory(agent, state_num);
+
+        long start = nowUs();
+        unsigned long sweeps = agent.recomputePayoffs(tn);
+        long us = nowUs() - start;
+        if (tn == 1)
+            base_us = us;
+
+        printf("Threads: %2u, sweeps: %lu, wall time: %.3f s, speedup: %.2f\n",
+                tn, sweeps, us / 1000000.0, 1.0 * base_us / us);
+    }
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+ * main.cpp
+ *
+ *  Run many avatars with unequal step budgets on AvatarRunner, and compare the throughput of different numbers of threads.
+ *  Usage: runner_test [max_threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "gamcs/CSOSAgent.h"
+#include "gamcs/AvatarRunner.h"
+#include "Wanderer.h"
+
+using namespace gamcs;
+
+const int AVATAR_NUM = 64;
+const int STATE_NUM = 1000;
+const int ACTION_NUM = 8;
+const int MAX_BUDGET = 4000;
+
+/**
+ * A wanderer, a few of them have a dead end.
+ */
+class DeadEndWanderer: public Wanderer
+{
+    public:
+        DeadEndWanderer(int id) :
+                Wanderer(id, STATE_NUM, ACTION_NUM)
+        {
+        }
+
+    private:
+        OSpace availableActions(Agent::State st)
+        {
+            if (id % 16 == 0 && st % 100 == 99)    // dead ends
+                return OSpace();
+            return Wanderer::availableActions(st);
+        }
+};
+
+int main(int argc, char *argv[])
+{
+    unsigned int max_threads = std::thread::hardware_concurrency();
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+    if (max_threads == 0)
+        max_threads = 1;
+
+    for (unsigned int tn = 1; tn <= max_threads; tn *= 2)
+    {
+        std::vector<CSOSAgent *> agents;
+        std::vector<Wanderer *> wanderers;
+        AvatarRunner runner(tn);
+        for (int i = 0; i < AVATAR_NUM; i++)
+        {
+            agents.push_back(new CSOSAgent(i, 0.9, 0.01));
+            agents[i]->setSeed(i);
+            wanderers.push_back(new DeadEndWanderer(i));
+            wanderers[i]->connectAgent(agents[i]);
+            runner.addAvatar(wanderers[i], MAX_BUDGET * (i % 8 + 1) / 8);    // unequal budgets
+        }
+
+        runner.run();
+        if (tn * 2 > max_threads)    // details of the last run
+            runner.report();
+        else
+            printf("Threads: %2u, %.0f steps/sec\n", tn,
+                    runner.totalSteps() / runner.elapsedTime());
+
+        for (int i = 0; i < AVATAR_NUM; i++)
+        {
+            delete wanderers[i];
+            delete agents[i];
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * main.cpp
+ *
+ *  Compare the convergence work of the SCC solver against breadth-first propagation on a cyclic memory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "gamcs/CSOSAgent.h"
+#include "Wanderer.h"
+
+using namespace gamcs;
+
+const int STATE_NUM = 5000;
+const int ACTION_NUM = 8;
+const int STEPS = 100000;
+
+/**
+ * Learn a memory without propagating any payoffs.
+ */
+void learn(CSOSAgent &agent)
+{
+    Wanderer wanderer(0, STATE_NUM, ACTION_NUM);
+    wanderer.connectAgent(&agent);
+    agent.setBatchSize(0);    // flush only when asked
+
+    srand(1);
+    for (int i = 0; i < STEPS; i++)
+    {
+        Agent::Action act = rand() % ACTION_NUM;
+        wanderer.teach(act);
+        wanderer.performAction(act);
+    }
+}
+
+double payoffSum(CSOSAgent &agent)
+{
+    double sum = 0;
+    for (Agent::State st = agent.firstState(); st != Agent::INVALID_STATE; st =
+            agent.nextState())
+    {
+        State_Info_Header *sthd = agent.getStateInfo(st);
+        sum += sthd->payoff;
+        free(sthd);
+    }
+    return sum;
+}
+
+int main(void)
+{
+    CSOSAgent bfs_agent(1, 0.9, 0.01);
+    learn(bfs_agent);
+    long start = nowUs();
+    bfs_agent.flush();    // one breadth-first propagation from all changed states
+    unsigned long one_pass_work = bfs_agent.updatedStateNum();
+    double one_pass_sum = payoffSum(bfs_agent);
+    // propagate from every state again and again until payoffs converge
+    int rounds = 1;
+    double sum = one_pass_sum, last_sum;
+    do
+    {
+        last_sum = sum;
+        for (Agent::State st = 0; st < STATE_NUM; st++)
+            bfs_agent.updatePayoff(st);
+        sum = payoffSum(bfs_agent);
+        rounds++;
+    } while (sum != last_sum);
+    long bfs_us = nowUs() - start;
+
+    CSOSAgent scc_agent(2, 0.9, 0.01);
+    learn(scc_agent);
+    start = nowUs();
+    unsigned long scc_work = scc_agent.solveAllPayoffs();
+    long scc_us = nowUs() - start;
+
+    printf("Steps: %d, states: %d, actions: %d\n", STEPS, STATE_NUM,
+            ACTION_NUM);
+    printf("Breadth-first, one pass: %lu state updates, payoff sum: %.2f\n",
+            one_pass_work, one_pass_sum);
+    printf("Breadth-first, %d rounds to converge: %lu state updates, %.3f ms, payoff sum: %.2f\n",
+            rounds, bfs_agent.updatedStateNum(), bfs_us / 1000.0,
+            payoffSum(bfs_agent));
+    printf("SCC solver: %lu state updates, %.3f ms, payoff sum: %.2f\n",
+            scc_work, scc_us / 1000.0, payoffSum(scc_agent));
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * main.cpp
+ *
+ *  Compare steps/sec and learned payoffs of a single CSOSAgent against ShardedAgent with different numbers of shards,
+ *  and check that payoffs of both converge to the same values on the same transitions.
+ *  Usage: sharded_test [max_shards]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "gamcs/CSOSAgent.h"
+#include "gamcs/ShardedAgent.h"
+#include "gamcs/OSAgent.h"
+#include "Wanderer.h"
+#ifdef _SQLITE_FOUND_
+#include "gamcs/Sqlite.h"
+#endif
+
+using namespace gamcs;
+
+const int STATE_NUM = 5000;
+const int ACTION_NUM = 8;
+const int STEPS = 20000;
+const float TOLERANCE = 0.01;    // the accuracy of the agents
+
+double payoffSum(OSAgent *agent)
+{
+    double sum = 0;
+    for (Agent::State st = agent->firstState(); st != Agent::INVALID_STATE;
+            st = agent->nextState())
+    {
+        State_Info_Header *sthd = agent->getStateInfo(st);
+        sum += sthd->payoff;
+        free(sthd);
+    }
+    return sum;
+}
+
+void report(const char *name, OSAgent *agent, double secs)
+{
+    Memory_Info *memif = agent->getMemoryInfo();
+    printf("%-12s %8.0f steps/sec, states: %u, links: %u, payoff sum: %.2f\n",
+            name, STEPS / secs, memif->state_num, memif->lk_num,
+            payoffSum(agent));
+    free(memif);
+}
+
+/**
+ * Count the states whose payoffs differ between two memories by more than a tolerance.
+ */
+int payoffDiff(OSAgent *expected, OSAgent *agent, float tolerance,
+        float *max_diff)
+{
+    int diff = 0;
+    *max_diff = 0;
+    for (Agent::State st = expected->firstState(); st != Agent::INVALID_STATE;
+            st = expected->nextState())
+    {
+        State_Info_Header *ex = expected->getStateInfo(st);
+        State_Info_Header *sthd = agent->getStateInfo(st);
+        float d = (sthd == NULL) ? 1e10 : fabs(ex->payoff - sthd->payoff);
+        if (d > *max_diff)
+            *max_diff = d;
+        if (d > tolerance)
+            diff++;
+        free(ex);
+        free(sthd);
+    }
+    return diff;
+}
+
+template<class T>
+void run(T *agent, const char *name, int batch_size)
+{
+    agent->setBatchSize(batch_size);
+    Wanderer wanderer(0, STATE_NUM, ACTION_NUM);
+    wanderer.connectAgent(agent);
+
+    double start = now();
+    for (int i = 0; i < STEPS; i++)
+        wanderer.step();
+    agent->flush();
+    report(name, agent, now() - start);
+
+#ifdef _SQLITE_FOUND_
+    Sqlite db("sharded_test.db");
+    start = now();
+    agent->dumpMemoryToStorage(&db);
+    double dump_secs = now() - start;
+    start = now();
+    agent->loadMemoryFromStorage(&db);
+    printf("%-12s dump %.3f secs, load %.3f secs\n", "", dump_secs,
+            now() - start);
+    remove("sharded_test.db");
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    int max_shards = 4;
+    if (argc > 1)
+        max_shards = atoi(argv[1]);
+
+    printf("Steps: %d, states: %d, actions: %d\n", STEPS, STATE_NUM,
+            ACTION_NUM);
+
+    // learning synchronized every step, all agents should follow the same path
+    printf("Synchronized:\n");
+    CSOSAgent single(1, 0.9, 0.01);
+    run(&single, "single", 1);
+    for (int sn = 1; sn <= max_shards; sn *= 2)
+    {
+        ShardedAgent sharded(1, 0.9, 0.01, sn);
+        char name[32];
+        sprintf(name, "shards: %d", sn);
+        run(&sharded, name, 1);
+    }
+
+    // shards learn asynchronously, decisions may be made on stale payoffs
+    printf("Asynchronous:\n");
+    for (int sn = 1; sn <= max_shards; sn *= 2)
+    {
+        ShardedAgent sharded(1, 0.9, 0.01, sn);
+        char name[32];
+        sprintf(name, "shards: %d", sn);
+        run(&sharded, name, 0);
+    }
+
+    // the same seed and random actions, so all agents see the same transitions, payoffs are compared with the fixed point
+    // recomputed by the single agent. A propagation updates every state once, so an agent is not exactly at the fixed point
+    // after learning, as the single agent shows, the shards are recomputed before being compared
+    printf("Converged (tolerance %.2f):\n", TOLERANCE);
+    CSOSAgent expected(1, 0.9, 0.01);
+    expected.setMode(Agent::EXPLORE);
+    expected.setSeed(7);
+    run(&expected, "fixed point", 1);
+    expected.recomputePayoffs();
+    int failed = 0;
+    {
+        CSOSAgent single(1, 0.9, 0.01);
+        single.setMode(Agent::EXPLORE);
+        single.setSeed(7);
+        run(&single, "single", 1);
+        float max_diff;
+        int diff = payoffDiff(&expected, &single, TOLERANCE, &max_diff);
+        printf("%-12s states differed: %d, max difference: %.4f\n", "", diff,
+                max_diff);
+    }
+    for (int sn = 1; sn <= max_shards; sn *= 2)
+    {
+        ShardedAgent sharded(1, 0.9, 0.01, sn);
+        sharded.setMode(Agent::EXPLORE);
+        sharded.setSeed(7);
+        char name[32];
+        sprintf(name, "shards: %d", sn);
+        run(&sharded, name, 0);
+        unsigned long rounds = sharded.recomputePayoffs();
+        float max_diff;
+        int diff = payoffDiff(&expected, &sharded, TOLERANCE, &max_diff);
+        printf("%-12s recomputed in %lu rounds, states differed: %d, max difference: %.4f, stale mirrors: %lu\n",
+                "", rounds, diff, max_diff, sharded.staleMirrorNum());
+        if (diff != 0)
+            failed++;
+    }
+
+    return failed;
+}
@@ -0,0 +1,103 @@
+/*
+ * main.cpp
+ *
+ *  Measure the aggregate steps/sec of many avatars learning one shared agent concurrently,
+ *  either a CSOSAgent learned session by session, or a ShardedAgent learned by the owner shards.
+ *  Usage: shared_test [max_threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "gamcs/CSOSAgent.h"
+#include "gamcs/ShardedAgent.h"
+#include "gamcs/AgentSession.h"
+#include "Wanderer.h"
+
+using namespace gamcs;
+
+const int STATE_NUM = 5000;
+const int ACTION_NUM = 8;
+const int STEPS = 20000;    // total steps of all avatars
+const int SHARD_NUM = 4;
+
+void run(Wanderer *wanderer, int steps)
+{
+    for (int i = 0; i < steps; i++)
+        wanderer->step();
+}
+
+/**
+ * Run tn avatars concurrently on sessions of a shared agent.
+ *
+ * @return aggregate steps/sec
+ */
+template<class T>
+double runSessions(T *shared, int tn)
+{
+    std::vector<AgentSession *> sessions;
+    std::vector<Wanderer *> wanderers;
+    for (int i = 0; i < tn; i++)
+    {
+        sessions.push_back(new AgentSession(shared, i));
+        wanderers.push_back(new Wanderer(i, STATE_NUM, ACTION_NUM));
+        wanderers[i]->connectAgent(sessions[i]);
+    }
+
+    double start = now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < tn; i++)
+        threads.push_back(std::thread(run, wanderers[i], STEPS / tn));
+    for (int i = 0; i < tn; i++)
+        threads[i].join();
+    shared->flush();    // until all transitions are learned
+    double secs = now() - start;
+
+    for (int i = 0; i < tn; i++)
+    {
+        delete wanderers[i];
+        delete sessions[i];
+    }
+    return (STEPS / tn) * tn / secs;
+}
+
+unsigned int stateNum(OSAgent *agent)
+{
+    Memory_Info *memif = agent->getMemoryInfo();
+    unsigned int sn = memif->state_num;
+    free(memif);
+    return sn;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = 32;
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+
+    printf("Total steps: %d, states: %d, actions: %d, hardware threads: %u\n",
+            STEPS, STATE_NUM, ACTION_NUM, std::thread::hardware_concurrency());
+    double single_base = 0, sharded_base = 0;
+    for (int tn = 1; tn <= max_threads; tn *= 2)
+    {
+        // sessions learn one by one
+        CSOSAgent shared(1, 0.9, 0.01);
+        double single = runSessions(&shared, tn);
+
+        // every state range is learned by its owner shard
+        ShardedAgent sharded(1, 0.9, 0.01, SHARD_NUM);
+        double shards = runSessions(&sharded, tn);
+
+        if (tn == 1)
+        {
+            single_base = single;
+            sharded_base = shards;
+        }
+        printf("Threads: %2d, one memory: %.0f steps/sec (x%.2f), states: %u, %d shards: %.0f steps/sec (x%.2f), states: %u\n",
+                tn, single, single / single_base, stateNum(&shared), SHARD_NUM,
+                shards, shards / sharded_base, stateNum(&sharded));
+    }
+
+    return 0;
+}
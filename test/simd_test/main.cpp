@@ -0,0 +1,131 @@
+/*
+ * main.cpp
+ *
+ *  Check that the vectorised payoff kernels give exactly the same action payoffs as CSOSAgent calculates
+ *  on its live memory, and compare their speed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <unordered_map>
+#include "gamcs/CSOSAgent.h"
+#include "gamcs/PayoffKernel.h"
+#include "Wanderer.h"
+
+using namespace gamcs;
+
+const int STATE_NUM = 10000;
+const int ACTION_NUM = 13;    // not a multiple of lanes, so the tails are tested too
+const int STEPS = 150000;
+const int ROUNDS = 50;
+
+int main(void)
+{
+    CSOSAgent agent(1, 0.9, 0.01);
+    Wanderer wanderer(0, STATE_NUM, ACTION_NUM);
+    wanderer.connectAgent(&agent);
+    srand(1);
+    for (int i = 0; i < STEPS; i++)
+    {
+        Agent::Action act = rand() % ACTION_NUM;
+        wanderer.teach(act);
+        wanderer.performAction(act);
+    }
+    agent.flush();
+
+    // a copy without trimming, so its action payoffs are the sums the kernels give
+    CSOSAgent exact(2, 0.9, 0);
+    agent.dumpMemoryToStorage(&exact);
+
+    // compile the memory as CSOSAgent does, each state has its actions consecutive
+    std::vector<Agent::State> states;
+    std::unordered_map<Agent::State, uint32_t> state_index;
+    for (Agent::State st = exact.firstState(); st != Agent::INVALID_STATE; st =
+            exact.nextState())
+    {
+        state_index[st] = states.size();
+        states.push_back(st);
+    }
+
+    std::vector<float> payoffs(states.size());
+    std::vector<uint32_t> act_start;
+    std::vector<Agent::Action> acts;
+    std::vector<uint32_t> eat_start;
+    std::vector<float> probs;
+    std::vector<uint32_t> nstates;
+    for (unsigned long si = 0; si < states.size(); si++)
+    {
+        State_Info_Header *sthd = exact.getStateInfo(states[si]);
+        payoffs[si] = sthd->payoff;
+        act_start.push_back(acts.size());
+
+        char *p = (char *) sthd + sizeof(State_Info_Header);
+        for (uint32_t j = 0; j < sthd->act_num; j++)
+        {
+            Action_Info_Header *athd = (Action_Info_Header *) p;
+            EnvAction_Info *eaif = (EnvAction_Info *) (athd + 1);
+            unsigned long sum = 0;
+            for (uint32_t k = 0; k < athd->eat_num; k++)
+                sum += eaif[k].count;
+
+            acts.push_back(athd->act);
+            eat_start.push_back(probs.size());
+            for (uint32_t k = 0; k < athd->eat_num; k++)
+            {
+                probs.push_back((1.0 / sum) * eaif[k].count);    // the same as CSOSAgent::prob()
+                nstates.push_back(state_index[eaif[k].nst]);
+            }
+            p = (char *) (eaif + athd->eat_num);
+        }
+        free(sthd);
+    }
+    act_start.push_back(acts.size());
+    eat_start.push_back(probs.size());
+
+    std::vector<float> expected(acts.size());
+    for (unsigned long si = 0; si < states.size(); si++)
+        for (uint32_t j = act_start[si]; j < act_start[si + 1]; j++)
+            expected[j] = exact.actionPayoff(states[si], acts[j]);
+    printf("States: %lu, actions: %lu, outcomes: %lu\n", states.size(),
+            acts.size(), probs.size());
+
+    const char *names[] = { "scalar", "avx2" };
+    std::vector<float> out(acts.size());
+    long scalar_us = 0;
+    int failed = 0;
+    for (int isa = PayoffKernel::SCALAR; isa <= PayoffKernel::AVX2; isa++)
+    {
+        if (!PayoffKernel::isSupported((PayoffKernel::Isa) isa))
+        {
+            printf("%-7s not supported by this CPU, skipped\n", names[isa]);
+            continue;
+        }
+
+        // state by state, as the agent decides
+        PayoffKernel kernel((PayoffKernel::Isa) isa);
+        long start = nowUs();
+        for (int r = 0; r < ROUNDS; r++)
+        {
+            for (unsigned long si = 0; si < states.size(); si++)
+                kernel.actionPayoffs(eat_start.data() + act_start[si],
+                        act_start[si + 1] - act_start[si], probs.data(),
+                        nstates.data(), payoffs.data(),
+                        out.data() + act_start[si]);
+        }
+        long us = nowUs() - start;
+        if (isa == PayoffKernel::SCALAR)
+            scalar_us = us;
+
+        unsigned long diff = 0;
+        for (unsigned long j = 0; j < acts.size(); j++)
+            if (out[j] != expected[j])
+                diff++;
+        if (diff != 0)
+            failed++;
+        printf("%-7s %lu actions differ from the agent, %.3f ms per round, speedup: %.2f\n",
+                names[isa], diff, us / 1000.0 / ROUNDS, 1.0 * scalar_us / us);
+    }
+
+    return failed;
+}
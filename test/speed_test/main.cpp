@@ -35,6 +35,11 @@ int main(void)
     mtime = ((seconds) * 1000 + useconds / 1000.0) + 0.5;
     printf("Elapsed time: %ld milliseconds\n", mtime);
 
+    unsigned long node_allocs, slab_allocs;
+    agent.getAllocationStats(&node_allocs, &slab_allocs);
+    printf("Allocations without pooling: %lu mallocs\n", node_allocs);
+    printf("Allocations with pooling: %lu mallocs\n", slab_allocs);
+
     return 0;
 }
 
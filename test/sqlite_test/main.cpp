@@ -0,0 +1,131 @@
+/*
+ * main.cpp
+ *
+ *  Measure dumping a memory to a Sqlite database, iterating the database and loading the memory back.
+ *  Usage: sqlite_test [steps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gamcs/CSOSAgent.h"
+#include "Wanderer.h"
+#ifdef _SQLITE_FOUND_
+#include "gamcs/Sqlite.h"
+#endif
+
+using namespace gamcs;
+
+const int STATE_NUM = 100000;
+const int ACTION_NUM = 4;
+const char *DB_NAME = "sqlite_test.db";
+
+int main(int argc, char *argv[])
+{
+#ifdef _SQLITE_FOUND_
+    int steps = 50000;
+    if (argc > 1)
+        steps = atoi(argv[1]);
+
+    CSOSAgent agent(1, 0.9, 0.01);
+    agent.setSeed(1);
+    agent.setMode(Agent::EXPLORE);
+    Wanderer wanderer(0, STATE_NUM, ACTION_NUM, false);
+    wanderer.connectAgent(&agent);
+    for (int i = 0; i < steps; i++)
+        wanderer.step();
+
+    remove(DB_NAME);
+    Sqlite db(DB_NAME);
+    double start = now();
+    agent.dumpMemoryToStorage(&db);
+    printf("Dump: %.3f secs\n", now() - start);
+
+    start = now();
+    agent.dumpMemoryToStorage(&db);    // states exist, they are updated
+    printf("Dump again: %.3f secs\n", now() - start);
+
+    // iterate states only, and states with their information
+    db.open(Storage::O_READ);
+    start = now();
+    unsigned long num = 0;
+    for (Agent::State st = db.firstState(); st != Agent::INVALID_STATE; st =
+            db.nextState())
+        num++;
+    printf("Iterate states: %lu states, %.3f secs\n", num, now() - start);
+
+    start = now();
+    double payoff_sum = 0;
+    for (Agent::State st = db.firstState(); st != Agent::INVALID_STATE; st =
+            db.nextState())
+    {
+        State_Info_Header *sthd = db.getStateInfo(st);
+        payoff_sum += sthd->payoff;
+        free(sthd);
+    }
+    printf("Iterate state information: %.3f secs, payoff sum: %.2f\n",
+            now() - start, payoff_sum);
+
+    // look up states out of the iteration order
+    start = now();
+    unsigned long found = 0;
+    for (unsigned long i = 0; i < num; i++)
+    {
+        State_Info_Header *sthd = db.getStateInfo((i * 7919) % STATE_NUM);
+        if (sthd != NULL)
+        {
+            found++;
+            free(sthd);
+        }
+    }
+    printf("Random lookups: %lu found, %.3f secs\n", found, now() - start);
+    db.close();
+
+    CSOSAgent loaded(1, 0.9, 0.01);
+    start = now();
+    loaded.loadMemoryFromStorage(&db);
+    Memory_Info *memif = loaded.getMemoryInfo();
+    printf("Load: %.3f secs, states: %u, links: %u\n", now() - start,
+            memif->state_num, memif->lk_num);
+    free(memif);
+
+#if INT_BITS == 64
+    // states differing only in the high 32 bits must not be mixed up under the cursor
+    remove(DB_NAME);
+    db.open(Storage::O_WRITE);
+    Agent::State wide[2] = { 5, (Agent::State(1) << 32) + 5 };
+    for (int i = 0; i < 2; i++)
+    {
+        State_Info_Header sthd;
+        memset(&sthd, 0, sizeof(sthd));
+        sthd.st = wide[i];
+        sthd.payoff = i;
+        sthd.count = 1;
+        sthd.size = sizeof(sthd);
+        db.addStateInfo(&sthd);
+    }
+    db.close();
+
+    db.open(Storage::O_READ);
+    int mixed = 0;
+    for (Agent::State st = db.firstState(); st != Agent::INVALID_STATE; st =
+            db.nextState())
+    {
+        Agent::State other = (st == wide[0]) ? wide[1] : wide[0];
+        State_Info_Header *sthd = db.getStateInfo(other);
+        if (sthd == NULL || sthd->st != other || !db.hasState(other))
+            mixed++;
+        free(sthd);
+    }
+    db.close();
+    printf("64-bit states mixed up: %d\n", mixed);
+#endif
+
+    remove(DB_NAME);
+#else
+    UNUSED(argc);
+    UNUSED(argv);
+    printf("Sqlite is not found!\n");
+#endif
+    return 0;
+}
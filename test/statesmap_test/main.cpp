@@ -0,0 +1,114 @@
+/*
+ * main.cpp
+ *
+ *  Benchmark FlatStatesMap against std::unordered_map at 1M and 10M states.
+ */
+
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include <unordered_map>
+#include "gamcs/FlatStatesMap.h"
+
+using namespace gamcs;
+
+long elapsedMs(struct timeval &start)
+{
+    struct timeval end;
+    gettimeofday(&end, NULL);
+    return (end.tv_sec - start.tv_sec) * 1000
+            + (end.tv_usec - start.tv_usec) / 1000;
+}
+
+// encode states the way examples do, in base 8 with a few digits changing at a time
+void makeKeys(unsigned long num, std::vector<gamcs_int> &keys)
+{
+    keys.resize(num);
+    for (unsigned long i = 0; i < num; i++)
+    {
+        gamcs_int st = 0, v = i;
+        for (int d = 0; d < 10; d++)
+        {
+            st = st * 8 + v % 8;
+            v /= 8;
+        }
+        keys[i] = st;
+    }
+}
+
+void benchStdMap(const std::vector<gamcs_int> &keys)
+{
+    std::unordered_map<gamcs_int, void *> map;
+    struct timeval start;
+    unsigned long found = 0;
+
+    gettimeofday(&start, NULL);
+    for (unsigned long i = 0; i < keys.size(); i++)
+        map.insert(std::unordered_map<gamcs_int, void *>::value_type(keys[i],
+                (void *) &keys[i]));
+    long insert_ms = elapsedMs(start);
+
+    gettimeofday(&start, NULL);
+    for (unsigned long i = 0; i < keys.size(); i++)
+        found += (map.find(keys[(i * 7919) % keys.size()]) != map.end());
+    long hit_ms = elapsedMs(start);
+
+    gettimeofday(&start, NULL);
+    for (unsigned long i = 0; i < keys.size(); i++)
+        found += (map.find(keys[i] + 1) != map.end());    // misses mostly
+    long miss_ms = elapsedMs(start);
+
+    printf("  unordered_map:           insert %6ld ms, hit %6ld ms, miss %6ld ms (%lu found)\n",
+            insert_ms, hit_ms, miss_ms, found);
+}
+
+void benchFlatMap(const std::vector<gamcs_int> &keys, bool reserved)
+{
+    FlatStatesMap map;
+    struct timeval start;
+    unsigned long found = 0;
+
+    gettimeofday(&start, NULL);
+    if (reserved)
+        map.reserve(keys.size());
+    for (unsigned long i = 0; i < keys.size(); i++)
+        map.insert(keys[i], (void *) &keys[i]);
+    long insert_ms = elapsedMs(start);
+
+    gettimeofday(&start, NULL);
+    for (unsigned long i = 0; i < keys.size(); i++)
+        found += (map.find(keys[(i * 7919) % keys.size()]) != NULL);
+    long hit_ms = elapsedMs(start);
+
+    gettimeofday(&start, NULL);
+    for (unsigned long i = 0; i < keys.size(); i++)
+        found += (map.find(keys[i] + 1) != NULL);
+    long miss_ms = elapsedMs(start);
+
+    printf("  FlatStatesMap%-11s insert %6ld ms, hit %6ld ms, miss %6ld ms (%lu found)\n",
+            reserved ? "(reserved):" : ":", insert_ms, hit_ms, miss_ms, found);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long sizes[2] = { 1000000, 10000000 };
+    int size_num = 2;
+    if (argc > 1)    // or a single size from command line
+    {
+        sizes[0] = strtoul(argv[1], NULL, 10);
+        size_num = 1;
+    }
+
+    std::vector<gamcs_int> keys;
+    for (int i = 0; i < size_num; i++)
+    {
+        makeKeys(sizes[i], keys);
+        printf("%lu states:\n", sizes[i]);
+        benchStdMap(keys);
+        benchFlatMap(keys, false);
+        benchFlatMap(keys, true);
+    }
+
+    return 0;
+}